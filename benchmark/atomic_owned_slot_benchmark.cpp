@@ -0,0 +1,105 @@
+// Measures read throughput of atomic_owned_slot against std::atomic_load on a shared_ptr,
+// for 1 up to all hardware threads reading while one writer keeps replacing the object.
+//
+// Usage: atomic_owned_slot_benchmark [milliseconds per run]
+
+#include "atomic_owned_slot.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+    volatile unsigned sink_out;
+
+    struct RoutingTable {
+        explicit RoutingTable(unsigned version) {
+            routes.fill(version);
+        }
+
+        std::array<unsigned, 16> routes{};
+    };
+
+    template<class ReaderLoop, class WriterStep>
+    double run(unsigned num_readers, std::chrono::milliseconds duration, ReaderLoop reader_loop,
+               WriterStep writer_step) {
+        std::atomic<bool> done{false};
+        std::vector<unsigned long long> reads(num_readers);
+        std::vector<std::thread> readers;
+        for (unsigned i = 0; i < num_readers; ++i) {
+            readers.emplace_back([&, i] { reads[i] = reader_loop(done); });
+        }
+        std::thread writer{[&] {
+            unsigned version = 0;
+            while (!done) {
+                writer_step(++version);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }};
+        std::this_thread::sleep_for(duration);
+        done = true;
+        writer.join();
+        unsigned long long total = 0;
+        for (unsigned i = 0; i < num_readers; ++i) {
+            readers[i].join();
+            total += reads[i];
+        }
+        return static_cast<double>(total) / std::chrono::duration<double>(duration).count();
+    }
+
+    double run_owned_slot(unsigned num_readers, std::chrono::milliseconds duration) {
+        atomic_owned_slot<RoutingTable> slot{make_owned<RoutingTable>(0u)};
+        return run(num_readers, duration, [&](const std::atomic<bool> &done) {
+            atomic_owned_slot<RoutingTable>::reader reader{slot};
+            unsigned long long count = 0;
+            unsigned sink = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                auto table = reader.read();
+                sink += table->routes[count & 15u];
+                ++count;
+            }
+            sink_out = sink;
+            return count;
+        }, [&](unsigned version) {
+            slot.store(make_owned<RoutingTable>(version));
+        });
+    }
+
+    double run_shared_ptr(unsigned num_readers, std::chrono::milliseconds duration) {
+        auto current = std::make_shared<const RoutingTable>(0u);
+        return run(num_readers, duration, [&](const std::atomic<bool> &done) {
+            unsigned long long count = 0;
+            unsigned sink = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                auto table = std::atomic_load(&current);
+                sink += table->routes[count & 15u];
+                ++count;
+            }
+            sink_out = sink;
+            return count;
+        }, [&](unsigned version) {
+            std::atomic_store(&current, std::make_shared<const RoutingTable>(version));
+        });
+    }
+}
+
+int main(int argc, char **argv) {
+    const auto duration = std::chrono::milliseconds(argc > 1 ? std::atoi(argv[1]) : 500);
+    const auto max_readers = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%8s %22s %22s\n", "readers", "atomic_owned_slot/s", "atomic shared_ptr/s");
+    for (unsigned readers = 1; readers <= max_readers; readers *= 2) {
+        const auto slot_rate = run_owned_slot(readers, duration);
+        const auto shared_rate = run_shared_ptr(readers, duration);
+        std::printf("%8u %22.0f %22.0f\n", readers, slot_rate, shared_rate);
+        if (readers < max_readers && readers * 2 > max_readers) {
+            readers = max_readers / 2;
+        }
+    }
+    return 0;
+}
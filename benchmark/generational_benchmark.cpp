@@ -0,0 +1,101 @@
+// Compares dependency checking by generation (generational_owned_ptr) with reference counting
+// (owned_ptr), for:
+//  - copying and destroying dependencies, which writes the reference count of the block
+//  - dereferencing a checked dependency
+//  - creating and releasing an owner with a dependency that outlives it
+//
+// Usage: generational_benchmark [number of objects] [rounds]
+
+#include "generational_ptr.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    struct Payload {
+        explicit Payload(unsigned v) : value{v} {}
+
+        unsigned value;
+    };
+
+    volatile unsigned sink_out;
+
+    template<class F>
+    double ns_per_operation(size_t operations, F &&f) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(operations);
+    }
+
+    /// Makes a copy of every dependency, reads through it and destroys it
+    template<class Dep>
+    double copy_deps(const std::vector<Dep> &deps, int rounds) {
+        return ns_per_operation(deps.size() * rounds, [&] {
+            unsigned sum = 0;
+            for (int round = 0; round < rounds; ++round) {
+                for (const auto &dep: deps) {
+                    Dep copy{dep};
+                    sum += copy->value;
+                }
+            }
+            sink_out = sum;
+        });
+    }
+
+    template<class Dep>
+    double dereference(const std::vector<Dep> &deps, int rounds) {
+        return ns_per_operation(deps.size() * rounds, [&] {
+            unsigned sum = 0;
+            for (int round = 0; round < rounds; ++round) {
+                for (const auto &dep: deps) {
+                    sum += dep->value;
+                }
+            }
+            sink_out = sum;
+        });
+    }
+
+    template<class Make>
+    double churn(size_t count, Make make) {
+        return ns_per_operation(count, [&] {
+            unsigned sum = 0;
+            for (size_t i = 0; i < count; ++i) {
+                auto owner = make(static_cast<unsigned>(i));
+                auto dep = owner.make_dep();
+                sum += dep->value;
+            }
+            sink_out = sum;
+        });
+    }
+}
+
+int main(int argc, char **argv) {
+    const auto count = static_cast<size_t>(argc > 1 ? std::atoi(argv[1]) : 1 << 16);
+    const auto rounds = argc > 2 ? std::atoi(argv[2]) : 100;
+
+    std::vector<owned_ptr<Payload>> counted_owners;
+    std::vector<dep_ptr<Payload>> counted_deps;
+    std::vector<generational_owned_ptr<Payload>> generational_owners;
+    std::vector<generational_dep_ptr<Payload>> generational_deps;
+    for (size_t i = 0; i < count; ++i) {
+        counted_owners.push_back(make_owned<Payload>(static_cast<unsigned>(i)));
+        counted_deps.push_back(counted_owners.back().make_dep());
+        generational_owners.push_back(make_generational<Payload>(static_cast<unsigned>(i)));
+        generational_deps.push_back(generational_owners.back().make_dep());
+    }
+
+    std::printf("%28s %16s %16s\n", "ns per operation", "counted", "generational");
+    std::printf("%28s %16zu %16zu\n", "dependency size (bytes)", sizeof(dep_ptr<Payload>),
+                sizeof(generational_dep_ptr<Payload>));
+    std::printf("%28s %16.2f %16.2f\n", "copy, read and destroy dep", copy_deps(counted_deps, rounds),
+                copy_deps(generational_deps, rounds));
+    std::printf("%28s %16.2f %16.2f\n", "dereference dep", dereference(counted_deps, rounds),
+                dereference(generational_deps, rounds));
+    std::printf("%28s %16.2f %16.2f\n", "create owner with dep",
+                churn(count * 10, [](unsigned v) { return make_owned<Payload>(v); }),
+                churn(count * 10, [](unsigned v) { return make_generational<Payload>(v); }));
+    return 0;
+}
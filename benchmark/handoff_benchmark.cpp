@@ -0,0 +1,259 @@
+// Measures objects that are created on one thread, handed through a queue to a second thread that
+// drops the owner, and released on a third, for owned_ptr with a dep_ptr against unique_ptr and a
+// pair of shared_ptr. Only one thread touches an object's reference count at a time, as the
+// non-atomic owned_ptr counts require.
+//
+// Three tables are printed:
+//  - pipeline throughput as the number of independent three-stage pipelines grows
+//  - the cost of the final release (and free) on the same thread and on another thread
+//  - the false-sharing cost of reference count updates on one thread while another thread writes
+//    to the object, with the object on the same cache line as the control block and padded away
+//
+// Usage: handoff_benchmark [milliseconds per run]
+
+#include "owned_ptr.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    // With the 16 byte control block, an owned Payload fills one 64 byte cache line
+    struct Payload {
+        explicit Payload(unsigned v) { bytes.fill(static_cast<char>(v)); }
+
+        std::array<char, 48> bytes{};
+    };
+
+    /// Single producer, single consumer ring buffer
+    template<class T, size_t Capacity = 1024>
+    class spsc_queue {
+    public:
+        bool try_push(T &&value) {
+            const auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+            _slots[tail % Capacity].emplace(std::move(value));
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        std::optional<T> try_pop() {
+            const auto head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire)) {
+                return std::nullopt;
+            }
+            std::optional<T> value{std::move(_slots[head % Capacity])};
+            _slots[head % Capacity].reset();
+            _head.store(head + 1, std::memory_order_release);
+            return value;
+        }
+
+    private:
+        std::array<std::optional<T>, Capacity> _slots{};
+        alignas(64) std::atomic<size_t> _head{0};
+        alignas(64) std::atomic<size_t> _tail{0};
+    };
+
+    /// The first handle is dropped by the second stage, the second by the third stage
+    struct owned_policy {
+        using first_type = owned_ptr<Payload>;
+        using second_type = dep_ptr<Payload, owned_ptr_error_handler>;
+
+        static std::pair<first_type, second_type> make(unsigned v) {
+            auto owner = make_owned<Payload>(v);
+            auto dep = owner.make_dep();
+            return {std::move(owner), std::move(dep)};
+        }
+    };
+
+    /// unique_ptr has nothing to share, so the object is freed by the second stage
+    struct unique_policy {
+        using first_type = std::unique_ptr<Payload>;
+        using second_type = std::unique_ptr<Payload>;
+
+        static std::pair<first_type, second_type> make(unsigned v) {
+            return {std::make_unique<Payload>(v), nullptr};
+        }
+    };
+
+    struct shared_policy {
+        using first_type = std::shared_ptr<Payload>;
+        using second_type = std::shared_ptr<Payload>;
+
+        static std::pair<first_type, second_type> make(unsigned v) {
+            auto first = std::make_shared<Payload>(v);
+            auto second = first;
+            return {std::move(first), std::move(second)};
+        }
+    };
+
+    template<class Queue, class T>
+    void push(Queue &queue, T &&value, const std::atomic<bool> &done) {
+        while (!queue.try_push(std::move(value))) {
+            if (done.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    /// Runs the given number of independent create -> drop owner -> release pipelines.
+    /// Returns the total number of objects per second.
+    template<class Policy>
+    double run_pipelines(unsigned pipelines, std::chrono::milliseconds duration) {
+        using message = std::pair<typename Policy::first_type, typename Policy::second_type>;
+        struct pipeline {
+            spsc_queue<message> to_second;
+            spsc_queue<typename Policy::second_type> to_third;
+            unsigned long long released{};
+        };
+        std::vector<std::unique_ptr<pipeline>> lines;
+        std::atomic<bool> done{false};
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < pipelines; ++i) {
+            lines.push_back(std::make_unique<pipeline>());
+            auto &line = *lines.back();
+            threads.emplace_back([&] {
+                for (unsigned v = 0; !done.load(std::memory_order_relaxed); ++v) {
+                    push(line.to_second, Policy::make(v), done);
+                }
+            });
+            threads.emplace_back([&] {
+                while (!done.load(std::memory_order_relaxed)) {
+                    if (auto m = line.to_second.try_pop()) {
+                        auto second = std::move(m->second);
+                        m.reset();
+                        push(line.to_third, std::move(second), done);
+                    }
+                }
+            });
+            threads.emplace_back([&] {
+                unsigned long long count = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    if (line.to_third.try_pop()) {
+                        ++count;
+                    }
+                }
+                line.released = count;
+            });
+        }
+        std::this_thread::sleep_for(duration);
+        done = true;
+        unsigned long long total = 0;
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        for (auto &line: lines) {
+            total += line->released;
+        }
+        return static_cast<double>(total) / std::chrono::duration<double>(duration).count();
+    }
+
+    /// Returns the average time in ns to release the last handle of count objects
+    template<class Policy>
+    double time_release(std::vector<typename Policy::first_type> &handles) {
+        const auto start = clock_type::now();
+        handles.clear();
+        const auto elapsed = clock_type::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(handles.capacity());
+    }
+
+    /// Compares releasing objects on the thread that allocated them with releasing them on another
+    /// thread (where the allocator has to return the memory to the allocating thread's arena)
+    template<class Policy>
+    std::pair<double, double> release_cost(size_t count) {
+        auto allocate = [count] {
+            std::vector<typename Policy::first_type> handles;
+            handles.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                handles.push_back(std::move(Policy::make(static_cast<unsigned>(i)).first));
+            }
+            return handles;
+        };
+        auto local = allocate();
+        const auto local_ns = time_release<Policy>(local);
+        auto remote = allocate();
+        double remote_ns = 0;
+        std::thread{[&] { remote_ns = time_release<Policy>(remote); }}.join();
+        return {local_ns, remote_ns};
+    }
+
+    template<size_t Padding>
+    struct PaddedPayload {
+        std::array<char, Padding> padding{};
+        unsigned counter{};
+    };
+
+    /// One thread copies and destroys a dep_ptr (writing the reference count) while another writes
+    /// to the object. Returns the number of dep copies per second.
+    template<class T>
+    double dep_churn_with_writer(std::chrono::milliseconds duration) {
+        auto owner = make_owned<T>();
+        auto *target = static_cast<T *>(owner);
+        auto dep = owner.make_dep();
+        std::atomic<bool> done{false};
+        std::thread writer{[&] {
+            auto *counter = reinterpret_cast<volatile unsigned *>(&target->counter);
+            while (!done.load(std::memory_order_relaxed)) {
+                *counter = *counter + 1;
+            }
+        }};
+        unsigned long long copies = 0;
+        const auto end = clock_type::now() + duration;
+        while (clock_type::now() < end) {
+            for (int i = 0; i < 1000; ++i) {
+                auto copy = dep;
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+            copies += 1000;
+        }
+        done = true;
+        writer.join();
+        return static_cast<double>(copies) / std::chrono::duration<double>(duration).count();
+    }
+}
+
+int main(int argc, char **argv) {
+    const auto duration = std::chrono::milliseconds(argc > 1 ? std::atoi(argv[1]) : 500);
+    const auto max_pipelines = std::max(1u, std::thread::hardware_concurrency() / 3);
+
+    std::printf("Pipeline throughput (objects/s), 3 threads per pipeline\n");
+    std::printf("%10s %16s %16s %16s\n", "pipelines", "owned_ptr+dep", "unique_ptr", "shared_ptr x2");
+    for (unsigned pipelines = 1; pipelines <= max_pipelines; pipelines *= 2) {
+        const auto owned = run_pipelines<owned_policy>(pipelines, duration);
+        const auto unique = run_pipelines<unique_policy>(pipelines, duration);
+        const auto shared = run_pipelines<shared_policy>(pipelines, duration);
+        std::printf("%10u %16.0f %16.0f %16.0f\n", pipelines, owned, unique, shared);
+        if (pipelines < max_pipelines && pipelines * 2 > max_pipelines) {
+            pipelines = max_pipelines / 2;
+        }
+    }
+
+    constexpr size_t release_count{1u << 18u};
+    std::printf("\nRelease of the last handle (ns per object)\n");
+    std::printf("%16s %16s %16s\n", "", "same thread", "other thread");
+    const auto owned = release_cost<owned_policy>(release_count);
+    std::printf("%16s %16.1f %16.1f\n", "owned_ptr", owned.first, owned.second);
+    const auto unique = release_cost<unique_policy>(release_count);
+    std::printf("%16s %16.1f %16.1f\n", "unique_ptr", unique.first, unique.second);
+    const auto shared = release_cost<shared_policy>(release_count);
+    std::printf("%16s %16.1f %16.1f\n", "shared_ptr", shared.first, shared.second);
+
+    std::printf("\ndep_ptr copies/s while another thread writes to the object\n");
+    std::printf("%24s %24s\n", "same line as Control", "64 bytes from Control");
+    std::printf("%24.0f %24.0f\n", dep_churn_with_writer<PaddedPayload<0>>(duration),
+                dep_churn_with_writer<PaddedPayload<64>>(duration));
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Measures receive-and-forward throughput over loopback sockets, with the received buffers
+// shared between a parser and a batched writev forwarder. Compares owned_buffer_pool
+// against a std::shared_ptr to a freshly allocated buffer per read.
+//
+// Usage: owned_buffer_pool_benchmark [megabytes per run] [buffer size]
+
+#include "owned_buffer_pool.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr size_t batch_size{16};
+
+    volatile unsigned sink_out;
+
+    struct SharedBuffer {
+        explicit SharedBuffer(size_t capacity) : bytes(capacity) {}
+
+        iovec readable_iovec() const {
+            return iovec{const_cast<char *>(bytes.data()), size};
+        }
+
+        std::vector<char> bytes;
+        size_t size{};
+    };
+
+    std::array<int, 2> make_socket_pair() {
+        std::array<int, 2> fds{};
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data())) {
+            std::perror("socketpair");
+            std::exit(1);
+        }
+        return fds;
+    }
+
+    unsigned parse(const char *data, size_t size) {
+        unsigned sum = 0;
+        for (size_t i = 0; i < size; i += 64) {
+            sum += static_cast<unsigned char>(data[i]);
+        }
+        return sum;
+    }
+
+    /// Sends total bytes into one socket pair, receives them with receive_step and drains the
+    /// forwarded bytes from the other. Returns the throughput in MB/s.
+    template<class ReceiveStep>
+    double run(size_t total, ReceiveStep receive_step) {
+        const auto in = make_socket_pair();
+        const auto out = make_socket_pair();
+        std::thread sender{[&] {
+            std::vector<char> chunk(64 * 1024, 'x');
+            for (size_t sent = 0; sent < total;) {
+                const auto n = write(in[0], chunk.data(), std::min(chunk.size(), total - sent));
+                if (n <= 0) {
+                    break;
+                }
+                sent += static_cast<size_t>(n);
+            }
+            shutdown(in[0], SHUT_WR);
+        }};
+        std::thread drain{[&] {
+            std::vector<char> chunk(64 * 1024);
+            while (read(out[1], chunk.data(), chunk.size()) > 0) {
+            }
+        }};
+        const auto start = std::chrono::steady_clock::now();
+        size_t received = 0;
+        for (;;) {
+            const auto n = receive_step(in[1], out[0]);
+            if (n == 0) {
+                break;
+            }
+            received += n;
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        shutdown(out[0], SHUT_WR);
+        sender.join();
+        drain.join();
+        for (const auto fd: {in[0], in[1], out[0], out[1]}) {
+            close(fd);
+        }
+        return static_cast<double>(received) / 1e6 / std::chrono::duration<double>(elapsed).count();
+    }
+
+    void write_batch(int fd, const iovec *vecs, size_t count) {
+        if (count && writev(fd, vecs, static_cast<int>(count)) < 0) {
+            std::perror("writev");
+            std::exit(1);
+        }
+    }
+
+    /// Forwards the queued buffers with a single writev, then releases them
+    void flush(std::vector<owned_buffer_pool<>::dep> &queue, int fd) {
+        std::array<iovec, batch_size> vecs{};
+        write_batch(fd, vecs.data(), export_iovecs(queue.begin(), queue.end(), vecs.data(), vecs.size()));
+        queue.clear();
+    }
+
+    void flush(std::vector<std::shared_ptr<const SharedBuffer>> &queue, int fd) {
+        std::array<iovec, batch_size> vecs{};
+        size_t count = 0;
+        for (const auto &buffer: queue) {
+            if (buffer->size) {
+                vecs[count++] = buffer->readable_iovec();
+            }
+        }
+        write_batch(fd, vecs.data(), count);
+        queue.clear();
+    }
+
+    double run_pool(size_t total, size_t buffer_size) {
+        owned_buffer_pool<> pool{buffer_size, batch_size + 1};
+        std::vector<owned_buffer_pool<>::dep> queue;
+        queue.reserve(batch_size);
+        unsigned sum = 0;
+        const auto result = run(total, [&](int in, int out) -> size_t {
+            auto buffer = pool.acquire();
+            const auto n = read(in, buffer.data(), buffer.capacity());
+            if (n <= 0) {
+                flush(queue, out);
+                return 0;
+            }
+            buffer.resize(static_cast<size_t>(n));
+            auto parser = buffer.make_dep();
+            queue.push_back(buffer.make_dep());
+            sum += parse(parser.data(), parser.size());
+            if (queue.size() == batch_size) {
+                flush(queue, out);
+            }
+            return static_cast<size_t>(n);
+        });
+        sink_out = sum;
+        return result;
+    }
+
+    double run_shared_ptr(size_t total, size_t buffer_size) {
+        std::vector<std::shared_ptr<const SharedBuffer>> queue;
+        queue.reserve(batch_size);
+        unsigned sum = 0;
+        const auto result = run(total, [&](int in, int out) -> size_t {
+            auto buffer = std::make_shared<SharedBuffer>(buffer_size);
+            const auto n = read(in, buffer->bytes.data(), buffer->bytes.size());
+            if (n <= 0) {
+                flush(queue, out);
+                return 0;
+            }
+            buffer->size = static_cast<size_t>(n);
+            auto parser = std::shared_ptr<const SharedBuffer>{buffer};
+            queue.push_back(std::move(buffer));
+            sum += parse(parser->bytes.data(), parser->size);
+            if (queue.size() == batch_size) {
+                flush(queue, out);
+            }
+            return static_cast<size_t>(n);
+        });
+        sink_out = sum;
+        return result;
+    }
+}
+
+int main(int argc, char **argv) {
+    const auto total = static_cast<size_t>(argc > 1 ? std::atoi(argv[1]) : 512) * 1000 * 1000;
+    const auto buffer_size = static_cast<size_t>(argc > 2 ? std::atoi(argv[2]) : 4096);
+    std::printf("%12s %22s %22s\n", "buffer size", "owned_buffer_pool MB/s", "shared_ptr MB/s");
+    const auto pool_rate = run_pool(total, buffer_size);
+    const auto shared_rate = run_shared_ptr(total, buffer_size);
+    std::printf("%12zu %22.0f %22.0f\n", buffer_size, pool_rate, shared_rate);
+    return 0;
+}
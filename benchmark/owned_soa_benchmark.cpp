@@ -0,0 +1,91 @@
+// Measures a particle integration kernel over owned_soa columns against the same kernel over
+// std::vector<owned_ptr<Particle>>, where every particle is a separate heap block.
+// Build with optimization (and e.g. -march=native) to let the column loops vectorize.
+//
+// Usage: owned_soa_benchmark [particles] [steps]
+
+#include "owned_soa.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    volatile float sink_out;
+
+    struct Particle {
+        float x, y, z;
+        float vx, vy, vz;
+    };
+
+    using particles = owned_soa<float, float, float, float, float, float>;
+
+    template<class Step>
+    double time_steps(unsigned steps, Step step) {
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < steps; ++i) {
+            step();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void integrate(float *__restrict p, const float *__restrict v, size_t n, float dt) {
+        for (size_t i = 0; i < n; ++i) {
+            p[i] += v[i] * dt;
+        }
+    }
+
+    double run_soa(size_t count, unsigned steps) {
+        particles soa{count};
+        std::vector<particles::row> rows;
+        rows.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto f = static_cast<float>(i);
+            rows.push_back(soa.add(f, f, f, 1.0f, 2.0f, 3.0f));
+        }
+        const auto seconds = time_steps(steps, [&] {
+            // The deps check once per column and step, not per particle
+            auto x = soa.make_column_dep<0>();
+            auto y = soa.make_column_dep<1>();
+            auto z = soa.make_column_dep<2>();
+            auto vx = soa.make_column_dep<3>();
+            auto vy = soa.make_column_dep<4>();
+            auto vz = soa.make_column_dep<5>();
+            integrate(x.data(), vx.data(), x.size(), 0.01f);
+            integrate(y.data(), vy.data(), y.size(), 0.01f);
+            integrate(z.data(), vz.data(), z.size(), 0.01f);
+        });
+        sink_out = soa.column<0>()[count / 2];
+        return seconds;
+    }
+
+    double run_owned_ptr(size_t count, unsigned steps) {
+        std::vector<owned_ptr<Particle>> particles;
+        particles.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto f = static_cast<float>(i);
+            particles.push_back(make_owned<Particle>(Particle{f, f, f, 1.0f, 2.0f, 3.0f}));
+        }
+        const auto seconds = time_steps(steps, [&] {
+            for (auto &p: particles) {
+                p->x += p->vx * 0.01f;
+                p->y += p->vy * 0.01f;
+                p->z += p->vz * 0.01f;
+            }
+        });
+        sink_out = particles[count / 2]->x;
+        return seconds;
+    }
+}
+
+int main(int argc, char **argv) {
+    const auto count = static_cast<size_t>(argc > 1 ? std::atoi(argv[1]) : 1 << 20);
+    const auto steps = static_cast<unsigned>(argc > 2 ? std::atoi(argv[2]) : 100);
+    const auto soa_seconds = run_soa(count, steps);
+    const auto owned_seconds = run_owned_ptr(count, steps);
+    const auto rate = [&](double seconds) { return static_cast<double>(count) * steps / seconds / 1e6; };
+    std::printf("%10s %24s %24s\n", "particles", "owned_soa Mparticles/s", "owned_ptr Mparticles/s");
+    std::printf("%10zu %24.0f %24.0f\n", count, rate(soa_seconds), rate(owned_seconds));
+    return 0;
+}
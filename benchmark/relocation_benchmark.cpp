@@ -0,0 +1,64 @@
+// Measures iteration over a vector of owners whose blocks have been scattered across the heap by
+// churn, before and after relocate_for_locality.
+//
+// Usage: relocation_benchmark [number of objects] [churn rounds]
+
+#include "owned_relocation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+    struct Particle {
+        double position[3];
+        double velocity[3];
+    };
+
+    volatile double sink_out;
+
+    /// Returns the time in ns per object of one pass that reads every object
+    double traverse(const std::vector<owned_ptr<Particle>> &particles) {
+        const auto start = std::chrono::steady_clock::now();
+        double sum = 0;
+        for (int pass = 0; pass < 10; ++pass) {
+            for (const auto &p: particles) {
+                sum += p->position[0] + p->velocity[0];
+            }
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        sink_out = sum;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / 10.0 /
+               static_cast<double>(particles.size());
+    }
+}
+
+int main(int argc, char **argv) {
+    const auto count = static_cast<size_t>(argc > 1 ? std::atoi(argv[1]) : 1 << 20);
+    const auto rounds = argc > 2 ? std::atoi(argv[2]) : 8;
+    std::mt19937 random{42};
+    std::vector<owned_ptr<Particle>> particles;
+    particles.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        particles.push_back(make_owned<Particle>());
+    }
+    // Replace random halves of the objects, so that new blocks land in the holes of old ones
+    for (int round = 0; round < rounds; ++round) {
+        std::shuffle(particles.begin(), particles.end(), random);
+        for (size_t i = 0; i < count / 2; ++i) {
+            particles[i] = make_owned<Particle>();
+        }
+    }
+    std::printf("%16s %16s\n", "scattered ns", "relocated ns");
+    const auto scattered = traverse(particles);
+    const auto start = std::chrono::steady_clock::now();
+    relocate_for_locality(particles.begin(), particles.end());
+    const auto relocation = std::chrono::steady_clock::now() - start;
+    const auto relocated = traverse(particles);
+    std::printf("%16.2f %16.2f\n", scattered, relocated);
+    std::printf("relocation took %.1f ms\n", std::chrono::duration<double, std::milli>(relocation).count());
+    return 0;
+}
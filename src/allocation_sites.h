@@ -0,0 +1,194 @@
+#ifndef OWNED_PTR_ALLOCATION_SITES_H
+#define OWNED_PTR_ALLOCATION_SITES_H
+
+// Attribution of owned_ptr blocks to the code that created them. Included by owned_ptr.h when
+// OWNED_PTR_TRACK_ALLOCATION_SITES is defined (for the whole program), in which case every block
+// records its allocation site in the control block. A site is the return address of the
+// owned_ptr constructor, try_create() or clone() call, which make_owned and try_make_owned are
+// forced to inline into. Sites are symbolized with dladdr when dumped; use addr2line on the
+// address for the file and line.
+//
+// The cost per block is three words in the control block, a deleter call when the owner is
+// released, a lookup in a small thread-local cache (a mutex and a hash map only on a miss) and a
+// few relaxed atomic additions.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+namespace owned_ptr_detail {
+    /// The counters of one allocation site
+    struct allocation_site {
+        const void *address{};
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> live_blocks{0};
+        std::atomic<size_t> live_bytes{0};
+        std::atomic<size_t> zombie_blocks{0};
+        std::atomic<size_t> zombie_bytes{0};
+        size_t allocations_at_last_snapshot{}; // Guarded by the registry mutex
+    };
+
+    class allocation_site_registry {
+    public:
+        /// Returns the site for a return address, creating it on first use
+        static allocation_site *find(const void *address) {
+            constexpr size_t cache_size{64};
+            struct cache_entry {
+                const void *address;
+                allocation_site *site;
+            };
+            static thread_local cache_entry cache[cache_size]{};
+            auto &entry = cache[(reinterpret_cast<uintptr_t>(address) >> 2u) % cache_size];
+            if (entry.address != address) {
+                entry = {address, find_slow(address)};
+            }
+            return entry.site;
+        }
+
+        template<class F>
+        static void for_each(F &&f) {
+            auto &r = instance();
+            std::lock_guard<std::mutex> lock{r.mutex};
+            for (auto &site: r.sites) {
+                f(*site.second);
+            }
+        }
+
+        /// Returns the seconds since the previous call (or since the first site was registered)
+        static double seconds_since_last_snapshot() {
+            auto &r = instance();
+            std::lock_guard<std::mutex> lock{r.mutex};
+            const auto now = std::chrono::steady_clock::now();
+            const auto seconds = std::chrono::duration<double>(now - r.last_snapshot).count();
+            r.last_snapshot = now;
+            return seconds;
+        }
+
+    private:
+        static allocation_site_registry &instance() {
+            // Never destroyed, since blocks may be released during static destruction
+            static auto *registry = new allocation_site_registry{};
+            return *registry;
+        }
+
+        static allocation_site *find_slow(const void *address) {
+            auto &r = instance();
+            std::lock_guard<std::mutex> lock{r.mutex};
+            auto &site = r.sites[address];
+            if (!site) {
+                site = new allocation_site{};
+                site->address = address;
+            }
+            return site;
+        }
+
+        std::mutex mutex;
+        std::unordered_map<const void *, allocation_site *> sites;
+        std::chrono::steady_clock::time_point last_snapshot{std::chrono::steady_clock::now()};
+    };
+
+    inline void site_allocated(allocation_site *site, size_t bytes) {
+        site->allocations.fetch_add(1, std::memory_order_relaxed);
+        site->live_blocks.fetch_add(1, std::memory_order_relaxed);
+        site->live_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /// Called when the owner is released. The block becomes a zombie if it has dependencies.
+    inline void site_owner_released(allocation_site *site, size_t bytes, bool zombie) {
+        site->live_blocks.fetch_sub(1, std::memory_order_relaxed);
+        site->live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        if (zombie) {
+            site->zombie_blocks.fetch_add(1, std::memory_order_relaxed);
+            site->zombie_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    /// Called when the last dependency of a zombie is released
+    inline void site_zombie_freed(allocation_site *site, size_t bytes) {
+        site->zombie_blocks.fetch_sub(1, std::memory_order_relaxed);
+        site->zombie_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    inline std::string symbolize(const void *address) {
+        Dl_info info{};
+        if (!dladdr(address, &info) || !info.dli_sname) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%p", address);
+            return buffer;
+        }
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        std::free(demangled);
+        char offset[32];
+        std::snprintf(offset, sizeof(offset), "+0x%zx",
+                      static_cast<size_t>(static_cast<const char *>(address) - static_cast<const char *>(info.dli_saddr)));
+        return name + offset;
+    }
+}
+
+/// Reports the owned_ptr blocks per allocation site, when OWNED_PTR_TRACK_ALLOCATION_SITES is
+/// defined. Without it, there are no sites to report.
+class owned_ptr_allocation_sites {
+public:
+    struct site {
+        const void *address;
+        std::string symbol;
+        size_t allocations;
+        double allocations_per_second; // Since the previous snapshot
+        size_t live_blocks;
+        size_t live_bytes;
+        size_t zombie_blocks;
+        size_t zombie_bytes;
+    };
+
+    /// Returns the sites that have blocks or have allocated since the previous snapshot, with
+    /// the most retained (live plus zombie) bytes first
+    static std::vector<site> snapshot() {
+        const auto seconds = owned_ptr_detail::allocation_site_registry::seconds_since_last_snapshot();
+        std::vector<site> sites;
+        owned_ptr_detail::allocation_site_registry::for_each([&](owned_ptr_detail::allocation_site &s) {
+            const auto allocations = s.allocations.load(std::memory_order_relaxed);
+            const auto recent = allocations - s.allocations_at_last_snapshot;
+            s.allocations_at_last_snapshot = allocations;
+            site result{s.address, {}, allocations, seconds > 0 ? static_cast<double>(recent) / seconds : 0,
+                        s.live_blocks.load(std::memory_order_relaxed), s.live_bytes.load(std::memory_order_relaxed),
+                        s.zombie_blocks.load(std::memory_order_relaxed),
+                        s.zombie_bytes.load(std::memory_order_relaxed)};
+            if (recent || result.live_blocks || result.zombie_blocks) {
+                sites.push_back(result);
+            }
+        });
+        std::sort(sites.begin(), sites.end(), [](const site &a, const site &b) {
+            return a.live_bytes + a.zombie_bytes > b.live_bytes + b.zombie_bytes;
+        });
+        for (auto &s: sites) {
+            s.symbol = owned_ptr_detail::symbolize(s.address);
+        }
+        return sites;
+    }
+
+    /// Prints a snapshot of up to max_sites sites as a table
+    static void dump(FILE *out, size_t max_sites = 20) {
+        const auto sites = snapshot();
+        std::fprintf(out, "%12s %12s %12s %12s %12s  %s\n", "live bytes", "live blocks", "zombie bytes",
+                     "zombies", "allocs/s", "site");
+        for (size_t i = 0; i < sites.size() && i < max_sites; ++i) {
+            const auto &s = sites[i];
+            std::fprintf(out, "%12zu %12zu %12zu %12zu %12.0f  %s\n", s.live_bytes, s.live_blocks, s.zombie_bytes,
+                         s.zombie_blocks, s.allocations_per_second, s.symbol.c_str());
+        }
+    }
+};
+
+#endif //OWNED_PTR_ALLOCATION_SITES_H
@@ -0,0 +1,176 @@
+#ifndef OWNED_PTR_ATOMIC_OWNED_SLOT_H
+#define OWNED_PTR_ATOMIC_OWNED_SLOT_H
+
+#include "owned_ptr.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/// Holds an owned object that many reader threads can access while a writer replaces it (RCU style).
+///
+/// Readers register once per thread by creating a reader, and then take cheap pinned views with
+/// reader::read(). A read is a plain store to the reader's own cache line, a fence and a load;
+/// there is no atomic read-modify-write and no reference counting on the read side.
+///
+/// A writer replaces the object with store(). The old owned_ptr is destroyed once every reader
+/// that might still see it has left its read section (the grace period), so dependencies created
+/// from the old version with make_dep() will report has_owner() == false after that.
+///
+/// Dependencies follow the usual owned_ptr rules: they must only be created, copied and destroyed
+/// on the writer side, never on the reader threads.
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class atomic_owned_slot {
+public:
+    class reader;
+
+    /// A pinned view of the current object. The object will not be destroyed while the view exists.
+    class read_guard {
+    public:
+        read_guard(const read_guard &other) = delete;
+
+        read_guard &operator=(const read_guard &other) = delete;
+
+        ~read_guard() {
+            _reader.unpin();
+        }
+
+        const T &operator*() const { return *_target; }
+
+        const T *operator->() const { return _target; }
+
+        operator const T *() const { return _target; } // NOLINT
+
+    private:
+        read_guard(reader &r, const T *target) : _reader{r}, _target{target} {}
+
+        reader &_reader;
+        const T *_target;
+
+        friend class reader;
+    };
+
+    /// Registration of a reader thread. Create one per thread that reads from the slot,
+    /// and use it only from that thread. It must be destroyed before the slot.
+    class reader {
+    public:
+        explicit reader(atomic_owned_slot &slot) : _slot{slot}, _thread{std::this_thread::get_id()} {
+            std::lock_guard<std::mutex> lock{_slot._writer_mutex};
+            _next = _slot._readers;
+            _slot._readers = this;
+        }
+
+        reader(const reader &other) = delete;
+
+        reader &operator=(const reader &other) = delete;
+
+        ~reader() {
+            ErrorHandler::check_condition(_depth == 0, "reader destroyed while a read_guard exists");
+            std::lock_guard<std::mutex> lock{_slot._writer_mutex};
+            auto **link = &_slot._readers;
+            while (*link != this) {
+                link = &(*link)->_next;
+            }
+            *link = _next;
+        }
+
+        /// Pins the current object and returns a view of it. Read sections may be nested.
+        [[nodiscard]] read_guard read() {
+            if (_depth++ == 0) {
+                _pinned.store(_slot._epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            return read_guard{*this, _slot._current.load(std::memory_order_acquire)};
+        }
+
+    private:
+        void unpin() {
+            if (--_depth == 0) {
+                _pinned.store(0, std::memory_order_release);
+            }
+        }
+
+        // Kept on a cache line of its own, so that readers never write to memory shared with
+        // other readers.
+        alignas(64) std::atomic<std::uint64_t> _pinned{0};
+        std::size_t _depth{0};
+        atomic_owned_slot &_slot;
+        std::thread::id _thread;
+        reader *_next{};
+
+        friend class atomic_owned_slot;
+    };
+
+    /// Creates a slot holding the given object
+    explicit atomic_owned_slot(owned_ptr<T, ErrorHandler> &&object) : _owner{std::move(object)} {
+        _current.store(target_of(_owner), std::memory_order_release);
+    }
+
+    atomic_owned_slot(const atomic_owned_slot &other) = delete;
+
+    atomic_owned_slot &operator=(const atomic_owned_slot &other) = delete;
+
+    ~atomic_owned_slot() {
+        ErrorHandler::check_condition(_readers == nullptr, "atomic_owned_slot destroyed while readers exist");
+    }
+
+    /// Replaces the current object.
+    /// Blocks until no reader can observe the old object any more, and then destroys it.
+    /// Must not be called by a thread that holds a read_guard from its own reader, since it would
+    /// wait for itself forever. That is reported as an error, and the slot is left unchanged.
+    void store(owned_ptr<T, ErrorHandler> &&object) {
+        std::lock_guard<std::mutex> lock{_writer_mutex};
+        if (!check_not_reading()) {
+            return;
+        }
+        auto old = std::move(_owner);
+        _owner = std::move(object);
+        _current.store(target_of(_owner), std::memory_order_seq_cst);
+        const auto epoch = _epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (auto *r = _readers; r; r = r->_next) {
+            for (;;) {
+                const auto pinned = r->_pinned.load(std::memory_order_acquire);
+                if (pinned == 0 || pinned >= epoch) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /// Creates a dependency on the current object (writer side only).
+    /// The dependency reports has_owner() == false once the object has been replaced
+    /// and its grace period has ended.
+    auto make_dep() const {
+        std::lock_guard<std::mutex> lock{_writer_mutex};
+        return _owner.make_dep();
+    }
+
+private:
+    /// Returns false, after reporting an error, if the calling thread has a pinned view
+    bool check_not_reading() const {
+        const auto self = std::this_thread::get_id();
+        for (auto *r = _readers; r; r = r->_next) {
+            // _depth is only read for the reader of the calling thread, which is the one that writes it
+            if (r->_thread == self && r->_depth) {
+                ErrorHandler::check_condition(false, "atomic_owned_slot::store() called while reading");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static const T *target_of(const owned_ptr<T, ErrorHandler> &owner) {
+        return owner;
+    }
+
+    owned_ptr<T, ErrorHandler> _owner;
+    std::atomic<const T *> _current{};
+    std::atomic<std::uint64_t> _epoch{1};
+    mutable std::mutex _writer_mutex;
+    reader *_readers{};
+};
+
+#endif //OWNED_PTR_ATOMIC_OWNED_SLOT_H
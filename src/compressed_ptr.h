@@ -0,0 +1,216 @@
+#ifndef OWNED_PTR_COMPRESSED_PTR_H
+#define OWNED_PTR_COMPRESSED_PTR_H
+
+#include "owned_region.h"
+
+#include <cstdint>
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class compressed_owned_ptr;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class compressed_dep_ptr;
+
+namespace owned_ptr_detail {
+    /// The base address of the region that compressed handles point into
+    inline char *compressed_base{};
+
+    inline char *compressed_block(std::uint32_t index) {
+        return compressed_base + static_cast<size_t>(index) * region_align;
+    }
+
+    inline std::uint32_t compressed_index(char *block) {
+        return static_cast<std::uint32_t>(static_cast<size_t>(block - compressed_base) / region_align);
+    }
+}
+
+/// The region that compressed_owned_ptr and compressed_dep_ptr point into.
+///
+/// A compressed handle stores its block as a 32 bit index, in units of the block alignment, from
+/// the start of the attached owned_region, instead of a 64 bit address. A handle is therefore half
+/// the size of an owned_ptr or dep_ptr, so twice as many edges of an object graph fit in a cache
+/// line, at the cost of an add and a shift on each dereference. Checking works as for
+/// owned_ptr: a dependency reports the deletion of its owner, and blocks stay alive while there
+/// are dependencies. Index 0 is the region header, so it doubles as nullptr.
+///
+/// There is one heap per process. It must be attached before the first compressed handle is
+/// created, and the region must stay attached and mapped until the last one is destroyed. Since
+/// the indices do not depend on the mapping address, a graph in a file backed region can be
+/// synced and attached again later, like one of region_owned_ptr.
+class compressed_heap {
+public:
+    /// The largest region that the 32 bit indices can address
+    static constexpr size_t max_size{(size_t{1} << 32u) * owned_ptr_detail::region_align};
+
+    /// Makes region the heap. Use owned_region::reserve() for a heap that only commits memory
+    /// as it is used.
+    static void attach(owned_region &region) {
+        owned_ptr_error_handler::check_condition(region.is_open(), "owned_region is not open");
+        owned_ptr_error_handler::check_condition(region.size() <= max_size,
+                                                 "owned_region is too large for compressed handles");
+        owned_ptr_detail::compressed_base = region._base;
+    }
+
+    static void detach() {
+        owned_ptr_detail::compressed_base = nullptr;
+    }
+
+    [[nodiscard]] static bool is_attached() { return owned_ptr_detail::compressed_base; }
+
+    /// Creates an object in the heap. Returns an empty handle (equal to nullptr) if the heap
+    /// is full. Exceptions from the constructor are passed on, after returning the block.
+    template<class T, class ErrorHandler = owned_ptr_error_handler, class... Args>
+    static compressed_owned_ptr<T, ErrorHandler> make_owned(Args &&... args) {
+        ErrorHandler::check_condition(is_attached(), "compressed_heap is not attached");
+        auto *block = owned_ptr_detail::region_create<T>(owned_ptr_detail::compressed_base,
+                                                         std::forward<Args>(args)...);
+        return compressed_owned_ptr<T, ErrorHandler>{block ? owned_ptr_detail::compressed_index(block) : 0};
+    }
+};
+
+/// The owner of an object in the compressed_heap. Works like owned_ptr, in 4 bytes.
+template<typename T, class ErrorHandler>
+class compressed_owned_ptr {
+public:
+    /// Creates an empty handle
+    compressed_owned_ptr() = default;
+
+    compressed_owned_ptr(const compressed_owned_ptr &other) = delete;
+
+    compressed_owned_ptr &operator=(const compressed_owned_ptr &other) = delete;
+
+    compressed_owned_ptr(compressed_owned_ptr &&other) noexcept: _index{other._index} {
+        other._index = 0;
+    }
+
+    compressed_owned_ptr &operator=(compressed_owned_ptr &&other) noexcept {
+        std::swap(_index, other._index);
+        return *this;
+    }
+
+    /// Destroys the object. The block goes back to the heap when the last dependency is gone.
+    ~compressed_owned_ptr() {
+        if (_index) {
+            owned_ptr_detail::region_release_owner<T>(owned_ptr_detail::compressed_block(_index));
+        }
+    }
+
+    /// Creates a dependency pointer
+    auto make_dep() {
+        return compressed_dep_ptr<T, ErrorHandler>{*this};
+    }
+
+    operator T *() { // NOLINT
+        ErrorHandler::check_condition(_index, "compressed_owned_ptr is empty");
+        return get_target(_index);
+    }
+
+    operator const T *() const { // NOLINT
+        ErrorHandler::check_condition(_index, "compressed_owned_ptr is empty");
+        return get_target(_index);
+    }
+
+    T *operator->() { // NOLINT
+        return *this;
+    }
+
+    const T *operator->() const { // NOLINT
+        return *this;
+    }
+
+    /// Returns the number of dependencies
+    [[nodiscard]] size_t num_deps() const {
+        return owned_ptr_core::num_deps(owned_ptr_detail::compressed_block(_index));
+    }
+
+    friend bool operator==(const compressed_owned_ptr &handle, std::nullptr_t) { return !handle._index; }
+
+    friend bool operator!=(const compressed_owned_ptr &handle, std::nullptr_t) { return handle._index; }
+
+private:
+    explicit compressed_owned_ptr(std::uint32_t index) : _index{index} {}
+
+    static T *get_target(std::uint32_t index) {
+        return reinterpret_cast<T *>(owned_ptr_detail::compressed_block(index) + owned_ptr_detail::region_data_offset());
+    }
+
+    std::uint32_t _index{};
+
+    friend class compressed_heap;
+
+    friend class compressed_dep_ptr<T, ErrorHandler>;
+};
+
+/// A dependency on an object in the compressed_heap. Works like dep_ptr, in 4 bytes.
+template<typename T, class ErrorHandler>
+class compressed_dep_ptr {
+private:
+    using Owner = compressed_owned_ptr<T, ErrorHandler>;
+
+public:
+    explicit compressed_dep_ptr(Owner &owned) : _index{owned._index} {
+        ErrorHandler::check_condition(_index, "compressed_owned_ptr is empty");
+        owned_ptr_core::add_dep(owned_ptr_detail::compressed_block(_index));
+    }
+
+    compressed_dep_ptr(const compressed_dep_ptr &other) : _index{other._index} {
+        if (_index) {
+            owned_ptr_core::add_dep(owned_ptr_detail::compressed_block(_index));
+        }
+    }
+
+    compressed_dep_ptr &operator=(const compressed_dep_ptr &other) {
+        compressed_dep_ptr tmp(other);
+        std::swap(_index, tmp._index);
+        return *this;
+    }
+
+    compressed_dep_ptr(compressed_dep_ptr &&other) noexcept: _index{other._index} {
+        if (ErrorHandler::reset_when_moved_from) {
+            other._index = 0;
+        } else if (_index) {
+            owned_ptr_core::add_dep(owned_ptr_detail::compressed_block(_index));
+        }
+    }
+
+    compressed_dep_ptr &operator=(compressed_dep_ptr &&other) noexcept {
+        if (ErrorHandler::reset_when_moved_from) {
+            std::swap(_index, other._index);
+        } else if (this != &other) {
+            compressed_dep_ptr tmp(other);
+            std::swap(_index, tmp._index);
+        }
+        return *this;
+    }
+
+    ~compressed_dep_ptr() {
+        if (_index) {
+            owned_ptr_detail::region_release_dep(owned_ptr_detail::compressed_block(_index));
+        }
+    }
+
+    operator T *() const { // NOLINT
+        return checked_target();
+    }
+
+    T *operator->() const { // NOLINT
+        return checked_target();
+    }
+
+    /// Returns true if the owner still exists
+    [[nodiscard]] bool has_owner() const {
+        return _index && owned_ptr_core::has_owner(owned_ptr_detail::compressed_block(_index));
+    }
+
+private:
+    T *checked_target() const {
+        ErrorHandler::check_condition(_index, "compressed_dep_ptr has been moved from");
+        ErrorHandler::check_condition(owned_ptr_core::has_owner(owned_ptr_detail::compressed_block(_index)),
+                                      "owner has been deleted");
+        return Owner::get_target(_index);
+    }
+
+    std::uint32_t _index;
+};
+
+#endif //OWNED_PTR_COMPRESSED_PTR_H
@@ -0,0 +1,206 @@
+#ifndef OWNED_PTR_GENERATIONAL_PTR_H
+#define OWNED_PTR_GENERATIONAL_PTR_H
+
+#include "owned_ptr.h"
+
+#include <cstdint>
+#include <mutex>
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class generational_owned_ptr;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class generational_dep_ptr;
+
+namespace owned_ptr_detail {
+    /// A block of a generational_pool. The generation is incremented each time the owner of the
+    /// object in the block is released, which invalidates every dependency that saw the old one.
+    template<typename T>
+    struct generational_block {
+        std::uint64_t generation;
+        generational_block *next_free;
+        alignas(T) unsigned char object[sizeof(T)];
+    };
+
+    /// The blocks of one target type. Released blocks are reused for new objects of the same
+    /// type, and are never returned to the system allocator, so that a stale dependency can
+    /// always read the generation of its block. The pool is shared by all threads, so the free
+    /// list is guarded by a mutex: objects may be created and released on any thread.
+    template<typename T>
+    class generational_pool {
+    public:
+        using block = generational_block<T>;
+
+        static block *acquire() {
+            {
+                std::lock_guard<std::mutex> lock{_mutex};
+                if (auto *b = _free) {
+                    _free = b->next_free;
+                    return b;
+                }
+            }
+            auto *b = static_cast<block *>(aligned_alloc(alignof(block), sizeof(block)));
+            if (b) {
+                b->generation = 0;
+            }
+            return b;
+        }
+
+        static void release(block *b) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            b->next_free = _free;
+            _free = b;
+        }
+
+    private:
+        static inline std::mutex _mutex;
+        static inline block *_free{};
+    };
+}
+
+/// The owner of an object whose dependencies are checked by generation instead of by
+/// reference counting.
+///
+/// A generational_dep_ptr stores the block pointer and the generation of the block when it was
+/// created. The owner increments the generation when it is released, so checking that the
+/// owner exists is a comparison, and copying or destroying a dependency writes no shared memory
+/// at all. The block goes back to the pool of its type as soon as the owner is released, rather
+/// than when the last dependency is gone.
+///
+/// The trade-offs, compared to owned_ptr and dep_ptr:
+///  - a dependency is 16 bytes instead of 8
+///  - the memory of released blocks is kept for reuse by the same type for the lifetime of the
+///    program, since stale dependencies may still read the generation
+///  - a dependency cannot tell how many others exist (there is no num_deps())
+///  - creating and releasing an owner takes the lock of the pool of its type
+/// See benchmark/generational_benchmark.cpp for the costs of both schemes.
+template<typename T, class ErrorHandler>
+class generational_owned_ptr {
+private:
+    using Pool = owned_ptr_detail::generational_pool<T>;
+    using Block = typename Pool::block;
+
+public:
+    /// Creates a new object. Throws std::bad_alloc if the allocation fails (or reports an error
+    /// and aborts, in builds without exceptions).
+    template<class... Args>
+    explicit generational_owned_ptr(Args &&... args) : _block{Pool::acquire()} {
+        if (!_block) {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+            throw std::bad_alloc{};
+#else
+            ErrorHandler::check_condition(false, "out of memory");
+            std::abort();
+#endif
+        }
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        try {
+            new(_block->object) T{std::forward<Args>(args)...};
+        } catch (...) {
+            Pool::release(_block);
+            throw;
+        }
+#else
+        new(_block->object) T{std::forward<Args>(args)...};
+#endif
+    }
+
+    generational_owned_ptr(const generational_owned_ptr &other) = delete;
+
+    generational_owned_ptr &operator=(const generational_owned_ptr &other) = delete;
+
+    generational_owned_ptr(generational_owned_ptr &&other) noexcept: _block{other._block} {
+        other._block = nullptr;
+    }
+
+    generational_owned_ptr &operator=(generational_owned_ptr &&other) noexcept {
+        std::swap(_block, other._block);
+        return *this;
+    }
+
+    /// Destroys the object, invalidates the dependencies and returns the block to the pool
+    ~generational_owned_ptr() {
+        if (!_block) {
+            return;
+        }
+        ++_block->generation;
+        target()->~T();
+        Pool::release(_block);
+    }
+
+    /// Creates a dependency pointer
+    auto make_dep() const {
+        return generational_dep_ptr<T, ErrorHandler>{*this};
+    }
+
+    operator T *() { // NOLINT
+        ErrorHandler::check_condition(_block, "generational_owned_ptr has been moved from");
+        return target();
+    }
+
+    operator const T *() const { // NOLINT
+        ErrorHandler::check_condition(_block, "generational_owned_ptr has been moved from");
+        return target();
+    }
+
+    T *operator->() { // NOLINT
+        return *this;
+    }
+
+    const T *operator->() const { // NOLINT
+        return *this;
+    }
+
+private:
+    T *target() const {
+        return reinterpret_cast<T *>(_block->object);
+    }
+
+    Block *_block;
+
+    friend class generational_dep_ptr<T, ErrorHandler>;
+};
+
+/// A dependency on the object of a generational_owned_ptr. Trivially copyable: copies and
+/// destruction do not touch the block.
+template<typename T, class ErrorHandler>
+class generational_dep_ptr {
+private:
+    using Block = owned_ptr_detail::generational_block<T>;
+
+public:
+    explicit generational_dep_ptr(const generational_owned_ptr<T, ErrorHandler> &owned)
+            : _block{owned._block}, _generation{owned._block ? owned._block->generation : 0} {
+        ErrorHandler::check_condition(_block, "generational_owned_ptr has been moved from");
+    }
+
+    operator T *() const { // NOLINT
+        return checked_target();
+    }
+
+    T *operator->() const { // NOLINT
+        return checked_target();
+    }
+
+    /// Returns true if the owner that this dependency was created from still exists
+    [[nodiscard]] bool has_owner() const {
+        return _block && _block->generation == _generation;
+    }
+
+private:
+    T *checked_target() const {
+        ErrorHandler::check_condition(has_owner(), "owner has been deleted");
+        return reinterpret_cast<T *>(_block->object);
+    }
+
+    Block *_block;
+    std::uint64_t _generation;
+};
+
+/// Creates a generational_owned_ptr<T> from the given constructor arguments
+template<class T, class... Args>
+inline auto make_generational(Args &&... args) {
+    return generational_owned_ptr<T>(std::forward<Args>(args)...);
+}
+
+#endif //OWNED_PTR_GENERATIONAL_PTR_H
@@ -0,0 +1,219 @@
+#ifndef OWNED_PTR_INTRUSIVE_OWNED_PTR_H
+#define OWNED_PTR_INTRUSIVE_OWNED_PTR_H
+
+#include "owned_ptr.h"
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class intrusive_owned_ptr;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class intrusive_dep_ptr;
+
+/// The control block of an object that is managed by intrusive_owned_ptr, as a base class of
+/// the object: the reference count with the owner marker, and the function that gives the object
+/// back to wherever it came from.
+///
+/// This lets objects that are allocated by a third party pool, or that live inside a larger
+/// structure, have an owner and dependencies without a heap block of their own. The object is
+/// not destroyed when its owner is released. Dependencies report the owner as deleted from
+/// then on, and once the owner and the last dependency are gone, the release function is called
+/// with the hook, to destroy the object and return it to its pool.
+class owned_control_hook {
+public:
+    using release_function = void (*)(owned_control_hook *);
+
+    explicit owned_control_hook(release_function release) : _release{release} {}
+
+    owned_control_hook(const owned_control_hook &other) = delete;
+
+    owned_control_hook &operator=(const owned_control_hook &other) = delete;
+
+    /// Returns true if an intrusive_owned_ptr owns the object
+    [[nodiscard]] bool has_owner() const {
+        return _ref_count >= owned_ptr_core::owner_marker;
+    }
+
+    /// Returns the number of dependencies
+    [[nodiscard]] size_t num_deps() const {
+        return _ref_count & ~owned_ptr_core::owner_marker;
+    }
+
+private:
+    void add_dep() {
+        ++_ref_count;
+    }
+
+    void release_dep() {
+        if (!--_ref_count) {
+            _release(this);
+        }
+    }
+
+    void release_owner() {
+        _ref_count &= ~owned_ptr_core::owner_marker;
+        if (!_ref_count) {
+            _release(this);
+        }
+    }
+
+    size_t _ref_count{};
+    release_function _release;
+
+    template<typename T, class ErrorHandler>
+    friend class intrusive_owned_ptr;
+
+    template<typename T, class ErrorHandler>
+    friend class intrusive_dep_ptr;
+};
+
+/// The owner of an object that derives from owned_control_hook. Works like owned_ptr, with
+/// the same checks and size, but does not allocate: it takes over an object that already exists.
+template<typename T, class ErrorHandler>
+class intrusive_owned_ptr {
+    static_assert(std::is_base_of<owned_control_hook, T>::value, "T must derive from owned_control_hook");
+
+public:
+    /// Creates an empty handle
+    intrusive_owned_ptr() = default;
+
+    /// Takes ownership of an object that has no owner or dependencies
+    explicit intrusive_owned_ptr(T *object) : _object{object} {
+        ErrorHandler::check_condition(object, "intrusive_owned_ptr created from nullptr");
+        ErrorHandler::check_condition(!hook().has_owner() && !hook().num_deps(), "object is already owned");
+        hook()._ref_count = owned_ptr_core::owner_marker;
+    }
+
+    intrusive_owned_ptr(const intrusive_owned_ptr &other) = delete;
+
+    intrusive_owned_ptr &operator=(const intrusive_owned_ptr &other) = delete;
+
+    intrusive_owned_ptr(intrusive_owned_ptr &&other) noexcept: _object{other._object} {
+        other._object = nullptr;
+    }
+
+    intrusive_owned_ptr &operator=(intrusive_owned_ptr &&other) noexcept {
+        std::swap(_object, other._object);
+        return *this;
+    }
+
+    /// Releases the object. It is passed to its release function now if there are no
+    /// dependencies, and otherwise when the last one is destroyed.
+    ~intrusive_owned_ptr() {
+        if (_object) {
+            hook().release_owner();
+        }
+    }
+
+    /// Creates a dependency pointer
+    auto make_dep() {
+        return intrusive_dep_ptr<T, ErrorHandler>{*this};
+    }
+
+    operator T *() { // NOLINT
+        ErrorHandler::check_condition(_object, "intrusive_owned_ptr has been moved from");
+        return _object;
+    }
+
+    operator const T *() const { // NOLINT
+        ErrorHandler::check_condition(_object, "intrusive_owned_ptr has been moved from");
+        return _object;
+    }
+
+    T *operator->() { // NOLINT
+        return *this;
+    }
+
+    const T *operator->() const { // NOLINT
+        return *this;
+    }
+
+    /// Returns the number of dependencies
+    [[nodiscard]] size_t num_deps() const { return hook().num_deps(); }
+
+    friend bool operator==(const intrusive_owned_ptr &handle, std::nullptr_t) { return !handle._object; }
+
+    friend bool operator!=(const intrusive_owned_ptr &handle, std::nullptr_t) { return handle._object; }
+
+private:
+    owned_control_hook &hook() const {
+        return *_object;
+    }
+
+    T *_object{};
+
+    friend class intrusive_dep_ptr<T, ErrorHandler>;
+};
+
+/// A dependency on an object owned by an intrusive_owned_ptr. Works like dep_ptr.
+template<typename T, class ErrorHandler>
+class intrusive_dep_ptr {
+public:
+    explicit intrusive_dep_ptr(intrusive_owned_ptr<T, ErrorHandler> &owned) : _object{owned._object} {
+        ErrorHandler::check_condition(_object, "intrusive_owned_ptr has been moved from");
+        hook().add_dep();
+    }
+
+    intrusive_dep_ptr(const intrusive_dep_ptr &other) : _object{other._object} {
+        if (_object) {
+            hook().add_dep();
+        }
+    }
+
+    intrusive_dep_ptr &operator=(const intrusive_dep_ptr &other) {
+        intrusive_dep_ptr tmp(other);
+        std::swap(_object, tmp._object);
+        return *this;
+    }
+
+    intrusive_dep_ptr(intrusive_dep_ptr &&other) noexcept: _object{other._object} {
+        if (ErrorHandler::reset_when_moved_from) {
+            other._object = nullptr;
+        } else if (_object) {
+            hook().add_dep();
+        }
+    }
+
+    intrusive_dep_ptr &operator=(intrusive_dep_ptr &&other) noexcept {
+        if (ErrorHandler::reset_when_moved_from) {
+            std::swap(_object, other._object);
+        } else if (this != &other) {
+            intrusive_dep_ptr tmp(other);
+            std::swap(_object, tmp._object);
+        }
+        return *this;
+    }
+
+    ~intrusive_dep_ptr() {
+        if (_object) {
+            hook().release_dep();
+        }
+    }
+
+    operator T *() const { // NOLINT
+        return checked_target();
+    }
+
+    T *operator->() const { // NOLINT
+        return checked_target();
+    }
+
+    /// Returns true if the owner still exists
+    [[nodiscard]] bool has_owner() const {
+        return _object && hook().has_owner();
+    }
+
+private:
+    owned_control_hook &hook() const {
+        return *_object;
+    }
+
+    T *checked_target() const {
+        ErrorHandler::check_condition(_object, "intrusive_dep_ptr has been moved from");
+        ErrorHandler::check_condition(hook().has_owner(), "owner has been deleted");
+        return _object;
+    }
+
+    T *_object;
+};
+
+#endif //OWNED_PTR_INTRUSIVE_OWNED_PTR_H
@@ -0,0 +1,313 @@
+#ifndef OWNED_PTR_OWNED_BUFFER_POOL_H
+#define OWNED_PTR_OWNED_BUFFER_POOL_H
+
+#include "owned_ptr.h"
+
+#include <sys/uio.h>
+
+/// A pool of fixed capacity byte buffers for zero-copy I/O.
+///
+/// acquire() returns the owner of a buffer, which fills it and hands dependencies to the
+/// consumers that need the bytes (parsers, writers, retransmit queues and so on). Unlike dep_ptr,
+/// a dependency keeps the bytes readable after the owner has released the buffer, since there is
+/// no object to destroy. The buffer goes back to the pool, not to free(), when the owner and
+/// the last dependency are gone, so the pool doubles as the "in flight" tracking that would
+/// otherwise need a shared_ptr per buffer.
+///
+/// Each buffer is a single heap block: the owned_ptr control block, a small header and the
+/// bytes as trailing storage. Like owned_ptr, the reference counts are not atomic, so a pool and
+/// its buffers must only be used from one thread at a time. The pool must outlive its buffers.
+template<class ErrorHandler = owned_ptr_error_handler>
+class owned_buffer_pool {
+private:
+    struct header {
+        owned_ptr_core::control control;
+        owned_buffer_pool *pool;
+        size_t size;
+        char *next_free;
+    };
+
+public:
+    class dep;
+
+    /// The owner of a buffer. Only the owner can write to the bytes.
+    class buffer {
+    public:
+        buffer(const buffer &other) = delete;
+
+        buffer &operator=(const buffer &other) = delete;
+
+        buffer(buffer &&other) noexcept: _storage{other._storage} {
+            other._storage = nullptr;
+        }
+
+        buffer &operator=(buffer &&other) noexcept {
+            std::swap(_storage, other._storage);
+            return *this;
+        }
+
+        /// Releases the buffer. It is returned to the pool now if there are no dependencies,
+        /// and otherwise when the last one is destroyed.
+        ~buffer() {
+            if (!_storage) {
+                return;
+            }
+            auto &control = owned_ptr_core::get_control(_storage);
+            control.ref_count &= ~owned_ptr_core::owner_marker;
+            if (!control.ref_count) {
+                get_header(_storage).pool->recycle(_storage);
+            }
+        }
+
+        char *data() {
+            ErrorHandler::check_condition(_storage, "owned buffer has been moved from");
+            return get_data(_storage);
+        }
+
+        [[nodiscard]] const char *data() const {
+            ErrorHandler::check_condition(_storage, "owned buffer has been moved from");
+            return get_data(_storage);
+        }
+
+        /// Returns the number of bytes in use
+        [[nodiscard]] size_t size() const {
+            ErrorHandler::check_condition(_storage, "owned buffer has been moved from");
+            return get_header(_storage).size;
+        }
+
+        /// Sets the number of bytes in use, e.g. after a read into the buffer.
+        /// Must not be changed while dependencies exist, since they expect the bytes to stay fixed.
+        void resize(size_t size) {
+            ErrorHandler::check_condition(_storage, "owned buffer has been moved from");
+            ErrorHandler::check_condition(size <= capacity(), "size exceeds the buffer capacity");
+            ErrorHandler::check_condition(!num_deps(), "owned buffer resized while it has dependencies");
+            get_header(_storage).size = size;
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            ErrorHandler::check_condition(_storage, "owned buffer has been moved from");
+            return get_header(_storage).pool->_capacity;
+        }
+
+        /// Creates a dependency that keeps the bytes readable and the buffer out of the pool
+        [[nodiscard]] dep make_dep() const {
+            ErrorHandler::check_condition(_storage, "owned buffer has been moved from");
+            return dep{_storage};
+        }
+
+        /// Returns the number of dependencies
+        [[nodiscard]] size_t num_deps() const { return owned_ptr_core::num_deps(_storage); }
+
+        /// Returns the whole capacity, for reading into the buffer with readv (scatter)
+        [[nodiscard]] iovec writable_iovec() {
+            return iovec{data(), capacity()};
+        }
+
+        /// Returns the bytes in use, for writing them with writev (gather)
+        [[nodiscard]] iovec readable_iovec() const {
+            return iovec{const_cast<char *>(data()), size()};
+        }
+
+    private:
+        explicit buffer(char *storage) : _storage{storage} {}
+
+        char *_storage;
+
+        friend class owned_buffer_pool;
+    };
+
+    /// A read-only dependency on a buffer, held by an in-flight consumer
+    class dep {
+    public:
+        dep(const dep &other) : _storage{other._storage} {
+            owned_ptr_core::add_dep(_storage);
+        }
+
+        dep &operator=(const dep &other) {
+            dep tmp(other);
+            std::swap(_storage, tmp._storage);
+            return *this;
+        }
+
+        dep(dep &&other) noexcept: _storage{other._storage} {
+            if (ErrorHandler::reset_when_moved_from) {
+                other._storage = nullptr;
+            } else {
+                owned_ptr_core::add_dep(_storage);
+            }
+        }
+
+        dep &operator=(dep &&other) noexcept {
+            if (ErrorHandler::reset_when_moved_from) {
+                std::swap(_storage, other._storage);
+            } else if (this != &other) {
+                dep tmp(other);
+                std::swap(_storage, tmp._storage);
+            }
+            return *this;
+        }
+
+        ~dep() {
+            if (_storage && !--owned_ptr_core::get_control(_storage).ref_count) {
+                get_header(_storage).pool->recycle(_storage);
+            }
+        }
+
+        [[nodiscard]] const char *data() const {
+            ErrorHandler::check_condition(_storage, "owned buffer dependency has been moved from");
+            return get_data(_storage);
+        }
+
+        [[nodiscard]] size_t size() const {
+            ErrorHandler::check_condition(_storage, "owned buffer dependency has been moved from");
+            return get_header(_storage).size;
+        }
+
+        /// Returns true if the owner of the buffer still exists.
+        /// The bytes stay readable either way.
+        [[nodiscard]] bool has_owner() const {
+            return _storage && owned_ptr_core::has_owner(_storage);
+        }
+
+        /// Returns the bytes, for writing them with writev (gather)
+        [[nodiscard]] iovec readable_iovec() const {
+            return iovec{const_cast<char *>(data()), size()};
+        }
+
+    private:
+        explicit dep(char *storage) : _storage{storage} {
+            owned_ptr_core::add_dep(_storage);
+        }
+
+        char *_storage;
+
+        friend class buffer;
+    };
+
+    /// Creates a pool of buffers with the given capacity in bytes.
+    /// \param capacity The capacity of every buffer.
+    /// \param preallocate The number of buffers to allocate up front.
+    /// Throws std::bad_alloc if the buffers cannot be allocated, like acquire().
+    explicit owned_buffer_pool(size_t capacity, size_t preallocate = 0) : _capacity{capacity} {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        try {
+            for (size_t i = 0; i < preallocate; ++i) {
+                recycle(allocate());
+            }
+        } catch (...) {
+            free_available();
+            throw;
+        }
+#else
+        for (size_t i = 0; i < preallocate; ++i) {
+            recycle(allocate());
+        }
+#endif
+    }
+
+    owned_buffer_pool(const owned_buffer_pool &other) = delete;
+
+    owned_buffer_pool &operator=(const owned_buffer_pool &other) = delete;
+
+    ~owned_buffer_pool() {
+        ErrorHandler::check_condition(_allocated == _available, "owned_buffer_pool destroyed while buffers are in use");
+        free_available();
+    }
+
+    /// Returns an empty buffer, reusing a released one if there is any.
+    /// Throws std::bad_alloc if a new buffer cannot be allocated (or reports an error and aborts,
+    /// in builds without exceptions).
+    [[nodiscard]] buffer acquire() {
+        char *storage = _free;
+        if (storage) {
+            _free = get_header(storage).next_free;
+            --_available;
+#ifdef OWNED_PTR_POISON_ZOMBIES
+            owned_ptr_detail::unpoison_memory(get_data(storage), _capacity);
+#endif
+        } else {
+            storage = allocate();
+        }
+        get_header(storage).control.ref_count = owned_ptr_core::owner_marker;
+        get_header(storage).size = 0;
+        return buffer{storage};
+    }
+
+    /// Returns the capacity of each buffer
+    [[nodiscard]] size_t capacity() const { return _capacity; }
+
+    /// Returns the number of buffers that are ready to be acquired
+    [[nodiscard]] size_t available() const { return _available; }
+
+    /// Returns the number of buffers that have an owner or dependencies
+    [[nodiscard]] size_t in_use() const { return _allocated - _available; }
+
+private:
+    static constexpr size_t data_offset() {
+        const auto align = std::alignment_of<std::max_align_t>::value;
+        return ((sizeof(header) + align - 1) / align) * align;
+    }
+
+    static header &get_header(char *storage) {
+        return *reinterpret_cast<header *>(storage);
+    }
+
+    static char *get_data(char *storage) {
+        return storage + data_offset();
+    }
+
+    char *allocate() {
+        const auto align = std::alignment_of<std::max_align_t>::value;
+        const auto size = ((data_offset() + _capacity + align - 1) / align) * align;
+        auto *storage = static_cast<char *>(aligned_alloc(align, size));
+        if (!storage) {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+            throw std::bad_alloc{};
+#else
+            ErrorHandler::check_condition(false, "out of memory");
+            std::abort();
+#endif
+        }
+        new(storage) header{{}, this, 0, nullptr};
+        ++_allocated;
+        return storage;
+    }
+
+    void free_available() {
+        while (_free) {
+            auto *storage = _free;
+            _free = get_header(storage).next_free;
+            free(storage);
+        }
+    }
+
+    void recycle(char *storage) {
+#ifdef OWNED_PTR_POISON_ZOMBIES
+        owned_ptr_detail::poison_memory(get_data(storage), _capacity);
+#endif
+        get_header(storage).next_free = _free;
+        _free = storage;
+        ++_available;
+    }
+
+    size_t _capacity;
+    char *_free{};
+    size_t _allocated{};
+    size_t _available{};
+};
+
+/// Writes the readable iovec of each buffer or dependency in [first, last) to out, skipping
+/// empty ones, for a single writev call. Returns the number of entries written.
+template<class It>
+size_t export_iovecs(It first, It last, iovec *out, size_t max_count) {
+    size_t count = 0;
+    for (; first != last && count < max_count; ++first) {
+        const auto vec = first->readable_iovec();
+        if (vec.iov_len) {
+            out[count++] = vec;
+        }
+    }
+    return count;
+}
+
+#endif //OWNED_PTR_OWNED_BUFFER_POOL_H
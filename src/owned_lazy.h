@@ -0,0 +1,284 @@
+#ifndef OWNED_PTR_OWNED_LAZY_H
+#define OWNED_PTR_OWNED_LAZY_H
+
+#include "owned_ptr.h"
+
+#include <atomic>
+#include <mutex>
+#include <tuple>
+
+/// Constructs the object of an owned_lazy on first access, for objects used by one thread
+struct lazy_single_thread {
+    template<class F>
+    void call_once(F &&f) {
+        if (!_done) {
+            f();
+            _done = true;
+        }
+    }
+
+private:
+    bool _done{};
+};
+
+/// Constructs the object of an owned_lazy exactly once, when several threads may access it
+/// first at the same time. The reference counts are still not atomic, so handles must only be
+/// created and destroyed on one thread at a time, as for owned_ptr.
+struct lazy_call_once {
+    template<class F>
+    void call_once(F &&f) {
+        if (!_done.load(std::memory_order_acquire)) {
+            std::call_once(_flag, [&] {
+                f();
+                _done.store(true, std::memory_order_release);
+            });
+        }
+    }
+
+private:
+    std::once_flag _flag;
+    std::atomic<bool> _done{false};
+};
+
+namespace owned_ptr_detail {
+    /// The part of a lazy block that does not depend on the constructor arguments
+    template<typename T, class Sync>
+    struct lazy_state {
+        Sync once;
+        T *object{};
+        void (*create)(lazy_state *);
+        bool failed{}; // Set if the constructor threw, since the arguments may have been moved from
+    };
+
+    template<typename T, class Sync, class... Args>
+    struct lazy_state_with_args {
+        lazy_state<T, Sync> state; // First, so that a pointer to this is a pointer to state
+        std::tuple<Args...> args;
+
+        static void create(lazy_state<T, Sync> *state) {
+            auto *self = reinterpret_cast<lazy_state_with_args *>(state);
+            state->object = std::apply([](Args &... args) { return new T{std::move(args)...}; }, self->args);
+        }
+    };
+}
+
+/// The owner of an object that is constructed on first access.
+///
+/// make_lazy() stores the constructor arguments in a small heap block, which also has the
+/// owned_ptr control block. The object is allocated and constructed when the owner or a
+/// dependency is first dereferenced (or when construct() is called), so an object that is
+/// never used costs only the small block. Dependencies can be created before the object is
+/// constructed, and work like dep_ptr: they report the deletion of the owner on access, and
+/// keep the small block alive. The object itself is deleted with the owner.
+///
+/// Sync is lazy_single_thread, or lazy_call_once if threads may race to construct the object.
+///
+/// If the constructor throws, the exception is passed to the caller that triggered the
+/// construction, and the owner is left in a failed state: the arguments may have been moved
+/// from, so the construction is not retried, and later accesses report an error and return
+/// nullptr.
+template<typename T, class ErrorHandler = owned_ptr_error_handler, class Sync = lazy_single_thread>
+class owned_lazy {
+private:
+    using State = owned_ptr_detail::lazy_state<T, Sync>;
+
+public:
+    /// A dependency on a lazily constructed object. Constructs the object on first access if
+    /// the owner has not done so yet.
+    class dep {
+    public:
+        dep(const dep &other) : _storage{other._storage} {
+            if (_storage) {
+                owned_ptr_core::add_dep(_storage);
+            }
+        }
+
+        dep &operator=(const dep &other) {
+            dep tmp(other);
+            std::swap(_storage, tmp._storage);
+            return *this;
+        }
+
+        dep(dep &&other) noexcept: _storage{other._storage} {
+            if (ErrorHandler::reset_when_moved_from) {
+                other._storage = nullptr;
+            } else if (_storage) {
+                owned_ptr_core::add_dep(_storage);
+            }
+        }
+
+        dep &operator=(dep &&other) noexcept {
+            if (ErrorHandler::reset_when_moved_from) {
+                std::swap(_storage, other._storage);
+            } else if (this != &other) {
+                dep tmp(other);
+                std::swap(_storage, tmp._storage);
+            }
+            return *this;
+        }
+
+        ~dep() {
+            if (_storage) {
+                owned_ptr_core::release_dep(_storage);
+            }
+        }
+
+        operator T *() const { // NOLINT
+            ErrorHandler::check_condition(_storage, "owned_lazy dependency has been moved from");
+            ErrorHandler::check_condition(owned_ptr_core::has_owner(_storage), "owner has been deleted");
+            return get_object(_storage);
+        }
+
+        T *operator->() const { // NOLINT
+            return *this;
+        }
+
+        /// Returns true if the owner still exists
+        [[nodiscard]] bool has_owner() const {
+            return _storage && owned_ptr_core::has_owner(_storage);
+        }
+
+    private:
+        explicit dep(char *storage) : _storage{storage} {
+            owned_ptr_core::add_dep(_storage);
+        }
+
+        char *_storage;
+
+        friend class owned_lazy;
+    };
+
+    owned_lazy(const owned_lazy &other) = delete;
+
+    owned_lazy &operator=(const owned_lazy &other) = delete;
+
+    owned_lazy(owned_lazy &&other) noexcept: _storage{other._storage} {
+        other._storage = nullptr;
+    }
+
+    owned_lazy &operator=(owned_lazy &&other) noexcept {
+        std::swap(_storage, other._storage);
+        return *this;
+    }
+
+    /// Deletes the object if it has been constructed. The small block is kept until the last
+    /// dependency is destroyed.
+    ~owned_lazy() {
+        if (_storage) {
+            owned_ptr_core::release_owner(_storage);
+        }
+    }
+
+    /// Creates an owner that constructs T from the given arguments on first access.
+    /// The arguments are copied or moved into the block now, and moved into T's constructor.
+    /// Throws std::bad_alloc if the allocation of the small block fails (or reports an error and
+    /// aborts, in builds without exceptions).
+    template<class... Args>
+    static owned_lazy create(Args &&... args) {
+        using Block = owned_ptr_detail::lazy_state_with_args<T, Sync, std::decay_t<Args>...>;
+        static_assert(alignof(Block) <= alignof(std::max_align_t), "over-aligned arguments are not supported");
+        auto *storage = static_cast<char *>(malloc(state_offset() + sizeof(Block)));
+        if (!storage) {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+            throw std::bad_alloc{};
+#else
+            ErrorHandler::check_condition(false, "out of memory");
+            std::abort();
+#endif
+        }
+        new(storage) owned_ptr_core::control{owned_ptr_core::owner_marker, &destroy<Block>};
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        try {
+            new(storage + state_offset()) Block{{{}, nullptr, &Block::create, false}, decltype(Block::args){std::forward<Args>(args)...}};
+        } catch (...) {
+            owned_ptr_core::free_block(storage);
+            throw;
+        }
+#else
+        new(storage + state_offset()) Block{{{}, nullptr, &Block::create, false}, decltype(Block::args){std::forward<Args>(args)...}};
+#endif
+        return owned_lazy{storage};
+    }
+
+    /// Constructs the object now if it has not been constructed yet
+    void construct() {
+        ErrorHandler::check_condition(_storage, "owned_lazy has been moved from");
+        get_object(_storage);
+    }
+
+    /// Returns true if the object has been constructed
+    [[nodiscard]] bool is_constructed() const {
+        ErrorHandler::check_condition(_storage, "owned_lazy has been moved from");
+        return get_state(_storage).object;
+    }
+
+    /// Creates a dependency pointer. Does not construct the object.
+    [[nodiscard]] dep make_dep() const {
+        ErrorHandler::check_condition(_storage, "owned_lazy has been moved from");
+        return dep{_storage};
+    }
+
+    operator T *() { // NOLINT
+        ErrorHandler::check_condition(_storage, "owned_lazy has been moved from");
+        return get_object(_storage);
+    }
+
+    operator const T *() const { // NOLINT
+        ErrorHandler::check_condition(_storage, "owned_lazy has been moved from");
+        return get_object(_storage);
+    }
+
+    T *operator->() { // NOLINT
+        return *this;
+    }
+
+    const T *operator->() const { // NOLINT
+        return *this;
+    }
+
+    /// Returns the number of dependencies
+    [[nodiscard]] size_t num_deps() const { return owned_ptr_core::num_deps(_storage); }
+
+private:
+    explicit owned_lazy(char *storage) : _storage{storage} {}
+
+    static constexpr size_t state_offset() {
+        const auto align = alignof(std::max_align_t);
+        return ((sizeof(owned_ptr_core::control) + align - 1) / align) * align;
+    }
+
+    static State &get_state(char *storage) {
+        return *reinterpret_cast<State *>(storage + state_offset());
+    }
+
+    static T *get_object(char *storage) {
+        auto &state = get_state(storage);
+        state.once.call_once([&state] {
+            if (!state.failed) {
+                state.failed = true;
+                state.create(&state);
+                state.failed = false;
+            }
+        });
+        ErrorHandler::check_condition(!state.failed, "owned_lazy construction failed");
+        return state.object;
+    }
+
+    /// The deleter of the block, called when the owner is released
+    template<class Block>
+    static void destroy(char *storage) {
+        auto *block = reinterpret_cast<Block *>(storage + state_offset());
+        delete block->state.object;
+        block->~Block();
+    }
+
+    char *_storage;
+};
+
+/// Creates an owned_lazy<T> that constructs T from the given arguments on first access
+template<class T, class... Args>
+inline auto make_lazy(Args &&... args) {
+    return owned_lazy<T>::create(std::forward<Args>(args)...);
+}
+
+#endif //OWNED_PTR_OWNED_LAZY_H
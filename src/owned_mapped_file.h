@@ -0,0 +1,273 @@
+#ifndef OWNED_PTR_OWNED_MAPPED_FILE_H
+#define OWNED_PTR_OWNED_MAPPED_FILE_H
+
+#include "owned_ptr.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// How a mapped file is going to be read, passed to madvise()
+enum class mapped_file_access {
+    normal = MADV_NORMAL,
+    sequential = MADV_SEQUENTIAL, // Aggressive read-ahead, pages can be dropped after use
+    random = MADV_RANDOM,         // No read-ahead
+    will_need = MADV_WILLNEED,    // Start paging in now
+};
+
+/// The owner of a read-only memory mapping of a file, for large immutable data such as models
+/// and indexes that many components read.
+///
+/// The file is not copied: pages are read in lazily by the kernel when they are first touched,
+/// which madvise() hints can steer. Readers get views, which are dependencies on the mapping,
+/// typed as spans of trivially copyable elements at any offset in the file. A view checks on
+/// every access that the owner still exists, like dep_ptr_const. The mapping is unmapped when
+/// the owner and the last view are gone, so a view that outlives its owner never reads
+/// unmapped memory.
+///
+/// The owned_ptr control block is in a small heap block next to the mapping, since the mapping
+/// is read-only. Like owned_ptr, the reference counts are not atomic.
+template<class ErrorHandler = owned_ptr_error_handler>
+class owned_mapped_file {
+private:
+    struct header {
+        owned_ptr_core::control control;
+        const char *data;
+        size_t size;
+    };
+
+public:
+    /// A read-only dependency on the elements [offset, offset + count * sizeof(T)) of the file
+    template<class T = char>
+    class view {
+        static_assert(std::is_trivially_copyable<T>::value, "mapped file views need trivially copyable elements");
+
+    public:
+        view(const view &other) : _storage{other._storage}, _data{other._data}, _count{other._count} {
+            if (_storage) {
+                owned_ptr_core::add_dep(_storage);
+            }
+        }
+
+        view &operator=(const view &other) {
+            view tmp(other);
+            swap(*this, tmp);
+            return *this;
+        }
+
+        view(view &&other) noexcept: _storage{other._storage}, _data{other._data}, _count{other._count} {
+            if (ErrorHandler::reset_when_moved_from) {
+                other._storage = nullptr;
+            } else if (_storage) {
+                owned_ptr_core::add_dep(_storage);
+            }
+        }
+
+        view &operator=(view &&other) noexcept {
+            if (ErrorHandler::reset_when_moved_from) {
+                swap(*this, other);
+            } else if (this != &other) {
+                view tmp(other);
+                swap(*this, tmp);
+            }
+            return *this;
+        }
+
+        ~view() {
+            if (_storage && !--owned_ptr_core::get_control(_storage).ref_count) {
+                release(_storage);
+            }
+        }
+
+        [[nodiscard]] const T *data() const {
+            check();
+            return _data;
+        }
+
+        /// Returns the number of elements
+        [[nodiscard]] size_t size() const { return _count; }
+
+        [[nodiscard]] bool empty() const { return !_count; }
+
+        const T &operator[](size_t index) const {
+            check();
+            ErrorHandler::check_condition(index < _count, "mapped file view index out of range");
+            return _data[index];
+        }
+
+        [[nodiscard]] const T *begin() const { return data(); }
+
+        [[nodiscard]] const T *end() const { return data() + _count; }
+
+        /// Returns a view of count elements of type U, starting offset bytes into this view
+        template<class U = T>
+        [[nodiscard]] view<U> subview(size_t offset, size_t count) const {
+            check();
+            return view<U>::make(_storage, reinterpret_cast<const char *>(_data), _count * sizeof(T), offset, count);
+        }
+
+        /// Returns true if the owner still exists
+        [[nodiscard]] bool has_owner() const {
+            return _storage && owned_ptr_core::has_owner(_storage);
+        }
+
+    private:
+        view(char *storage, const T *data, size_t count) : _storage{storage}, _data{data}, _count{count} {
+            owned_ptr_core::add_dep(_storage);
+        }
+
+        /// Checks that [offset, offset + count * sizeof(T)) is within the size bytes at base
+        static view make(char *storage, const char *base, size_t size, size_t offset, size_t count) {
+            ErrorHandler::check_condition(offset <= size && count <= (size - offset) / sizeof(T),
+                                          "mapped file view out of range");
+            ErrorHandler::check_condition(reinterpret_cast<uintptr_t>(base + offset) % alignof(T) == 0,
+                                          "mapped file view is misaligned");
+            return view{storage, reinterpret_cast<const T *>(base + offset), count};
+        }
+
+        void check() const {
+            ErrorHandler::check_condition(_storage, "mapped file view has been moved from");
+            ErrorHandler::check_condition(owned_ptr_core::has_owner(_storage), "owner has been deleted");
+        }
+
+        static void swap(view &lhs, view &rhs) {
+            std::swap(lhs._storage, rhs._storage);
+            std::swap(lhs._data, rhs._data);
+            std::swap(lhs._count, rhs._count);
+        }
+
+        char *_storage;
+        const T *_data;
+        size_t _count;
+
+        friend class owned_mapped_file;
+
+        template<class U>
+        friend class view;
+    };
+
+    /// Creates an empty handle
+    owned_mapped_file() = default;
+
+    owned_mapped_file(const owned_mapped_file &other) = delete;
+
+    owned_mapped_file &operator=(const owned_mapped_file &other) = delete;
+
+    owned_mapped_file(owned_mapped_file &&other) noexcept: _storage{other._storage} {
+        other._storage = nullptr;
+    }
+
+    owned_mapped_file &operator=(owned_mapped_file &&other) noexcept {
+        std::swap(_storage, other._storage);
+        return *this;
+    }
+
+    /// Releases the mapping. It is unmapped now if there are no views, and otherwise when the
+    /// last one is destroyed.
+    ~owned_mapped_file() {
+        if (!_storage) {
+            return;
+        }
+        auto &control = owned_ptr_core::get_control(_storage);
+        control.ref_count &= ~owned_ptr_core::owner_marker;
+        if (!control.ref_count) {
+            release(_storage);
+        }
+    }
+
+    /// Maps a file read-only. Check the result with is_open(); errno tells why if it failed.
+    static owned_mapped_file open(const char *path, mapped_file_access access = mapped_file_access::normal) {
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return owned_mapped_file{};
+        }
+        struct stat st{};
+        if (fstat(fd, &st)) {
+            close(fd);
+            return owned_mapped_file{};
+        }
+        const auto size = static_cast<size_t>(st.st_size);
+        void *data = nullptr;
+        if (size) {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            return owned_mapped_file{};
+        }
+        auto *storage = static_cast<char *>(malloc(sizeof(header)));
+        if (!storage) {
+            if (data) {
+                munmap(data, size);
+            }
+            return owned_mapped_file{};
+        }
+        new(storage) header{{owned_ptr_core::owner_marker, nullptr}, static_cast<const char *>(data), size};
+        owned_mapped_file file{storage};
+        file.advise(access);
+        return file;
+    }
+
+    [[nodiscard]] bool is_open() const { return _storage; }
+
+    [[nodiscard]] const char *data() const {
+        ErrorHandler::check_condition(_storage, "owned_mapped_file is not open");
+        return get_header(_storage).data;
+    }
+
+    /// Returns the size of the file in bytes
+    [[nodiscard]] size_t size() const {
+        ErrorHandler::check_condition(_storage, "owned_mapped_file is not open");
+        return get_header(_storage).size;
+    }
+
+    /// Creates a view of the whole file
+    [[nodiscard]] view<char> make_dep() const {
+        return make_view<char>(0, size());
+    }
+
+    /// Creates a view of count elements of type T, starting offset bytes into the file.
+    /// The range must be within the file and suitably aligned for T.
+    template<class T>
+    [[nodiscard]] view<T> make_view(size_t offset, size_t count) const {
+        return view<T>::make(_storage, data(), size(), offset, count);
+    }
+
+    /// Tells the kernel how [offset, offset + length) is going to be read. Returns false if the
+    /// hint was rejected; hints never change the contents.
+    bool advise(mapped_file_access access, size_t offset = 0, size_t length = size_t(-1)) const {
+        ErrorHandler::check_condition(_storage, "owned_mapped_file is not open");
+        const auto &h = get_header(_storage);
+        if (offset >= h.size) {
+            return h.size == 0;
+        }
+        // madvise() needs a page aligned start
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const auto start = offset / page * page;
+        const auto end = length < h.size - offset ? offset + length : h.size;
+        return madvise(const_cast<char *>(h.data) + start, end - start, static_cast<int>(access)) == 0;
+    }
+
+    /// Returns the number of views
+    [[nodiscard]] size_t num_deps() const { return owned_ptr_core::num_deps(_storage); }
+
+private:
+    explicit owned_mapped_file(char *storage) : _storage{storage} {}
+
+    static header &get_header(char *storage) {
+        return *reinterpret_cast<header *>(storage);
+    }
+
+    static void release(char *storage) {
+        auto &h = get_header(storage);
+        if (h.data) {
+            munmap(const_cast<char *>(h.data), h.size);
+        }
+        free(storage);
+    }
+
+    char *_storage{};
+};
+
+#endif //OWNED_PTR_OWNED_MAPPED_FILE_H
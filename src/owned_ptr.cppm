@@ -0,0 +1,31 @@
+// C++20 module interface for owned_ptr.
+// Built by the owned_ptr_module target when OWNED_PTR_BUILD_MODULE is enabled.
+
+module;
+
+#include "owned_ptr.h"
+
+export module owned_ptr;
+
+export {
+    using ::owned_ptr_error_handler;
+    using ::sampling_error_handler;
+    using ::owned_ptr_core;
+    using ::owned_ptr;
+    using ::dep_ptr;
+    using ::dep_ptr_const;
+    using ::make_owned;
+    using ::make_owned_n;
+    using ::try_make_owned;
+    using ::owned_ptr_safepoint;
+    using ::owned_ptr_identity;
+    using ::owned_ptr_hash;
+    using ::owned_ptr_equal;
+    using ::owned_ptr_less;
+    using ::operator==;
+    using ::operator!=;
+    using ::operator<;
+    using ::operator>;
+    using ::operator<=;
+    using ::operator>=;
+}
@@ -5,9 +5,51 @@
 #ifndef OWNED_PTR_OWNED_PTR_H
 #define OWNED_PTR_OWNED_PTR_H
 
+#include "owned_ptr_fwd.h"
+
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
-#include <memory>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <typeindex> // The lightest standard header that declares std::hash
+#include <utility>
+
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define OWNED_PTR_HAS_EXCEPTIONS 1
+#endif
+
+// C++20 lets owned_ptr, dep_ptr and dep_ptr_const be used in constant evaluation
+#if defined(__cpp_constexpr_dynamic_alloc) && defined(__cpp_lib_is_constant_evaluated)
+#define OWNED_PTR_CONSTEXPR constexpr
+#else
+#define OWNED_PTR_CONSTEXPR
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define OWNED_PTR_HAS_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define OWNED_PTR_HAS_ASAN 1
+#endif
+#endif
+
+#ifdef OWNED_PTR_HAS_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+#include "allocation_sites.h"
+#endif
+
+#if defined(__has_include)
+#if __has_include(<valgrind/memcheck.h>)
+#include <valgrind/memcheck.h>
+#define OWNED_PTR_HAS_VALGRIND 1
+#endif
+#endif
 
 struct owned_ptr_error_handler {
     static void check_condition(bool condition, const char *reason) {
@@ -30,53 +72,557 @@ struct owned_ptr_error_handler {
     // Leave moved-from objects valid in Release builds, for performance
     static constexpr bool reset_when_moved_from{true};
 #endif
+    // Setting this to true records the thread that created the owned_ptr
+    // in its control block, and reports an error when a dependency is
+    // created, copied or destroyed on another thread (the reference count
+    // is not atomic, so that would be a data race).
+    // Use transfer_to_current_thread() for deliberate hand-overs.
+    // When false, the control block has the same layout as without the check.
+    static constexpr bool check_thread_affinity{false};
+
+    // Setting this to true forbids zombie blocks: destroying an owned_ptr
+    // that still has dependencies is reported as an error, and the block
+    // is freed by the owner. Dependencies then never free the block, so
+    // their destructor is only a decrement. If the error handler returns
+    // after reporting remaining dependencies, the block is leaked rather
+    // than freed, so that those dependencies stay memory safe.
+    static constexpr bool forbid_zombies{false};
+
+    // Setting this to true defers the reference count updates of
+    // dependencies: copies and destruction are recorded in a small
+    // thread-local table, where the changes to the same block cancel out,
+    // and are applied when an entry is needed for another block, when the
+    // owner is destroyed or asked for num_deps(), at owned_ptr_safepoint()
+    // and at thread exit. Zombie blocks are freed when their changes are
+    // applied. Owner checks are unaffected. Call owned_ptr_safepoint()
+    // before handing dependencies or owners to another thread.
+    static constexpr bool defer_ref_counts{false};
 };
 
-template<typename T, class ErrorHandler>
-class dep_ptr;
+namespace owned_ptr_detail {
+    /// Marks memory as inaccessible for AddressSanitizer and Valgrind, when available.
+    /// Used on the object storage of zombie blocks (owner destroyed, dependencies remaining)
+    /// when OWNED_PTR_POISON_ZOMBIES is defined.
+    inline void poison_memory(const void *address, size_t size) {
+        (void) address;
+        (void) size;
+#ifdef OWNED_PTR_HAS_ASAN
+        ASAN_POISON_MEMORY_REGION(address, size);
+#endif
+#ifdef OWNED_PTR_HAS_VALGRIND
+        VALGRIND_MAKE_MEM_NOACCESS(address, size);
+#endif
+    }
 
-template<typename T, class ErrorHandler>
-class dep_ptr_const;
+    /// Makes poisoned memory accessible again. Must be called before storage is reused by
+    /// anything other than the system allocator (which resets the state on free and malloc).
+    inline void unpoison_memory(const void *address, size_t size) {
+        (void) address;
+        (void) size;
+#ifdef OWNED_PTR_HAS_ASAN
+        ASAN_UNPOISON_MEMORY_REGION(address, size);
+#endif
+#ifdef OWNED_PTR_HAS_VALGRIND
+        VALGRIND_MAKE_MEM_UNDEFINED(address, size);
+#endif
+    }
+
+    template<class ErrorHandler, class = void>
+    struct has_sampling : std::false_type {
+    };
+
+    template<class ErrorHandler>
+    struct has_sampling<ErrorHandler, std::void_t<decltype(ErrorHandler::sample())>> : std::true_type {
+    };
+
+    /// Returns true if a dep_ptr dereference should be fully checked.
+    /// Always true unless the error handler defines a sample() function.
+    template<class ErrorHandler>
+    inline bool sample_check() {
+        if constexpr (has_sampling<ErrorHandler>::value) {
+            return ErrorHandler::sample();
+        } else {
+            return true;
+        }
+    }
+
+    /// Makes the next dereference on this thread fully checked, if the error handler samples checks.
+    template<class ErrorHandler>
+    inline void force_check() {
+        if constexpr (has_sampling<ErrorHandler>::value) {
+            ErrorHandler::force_check();
+        }
+    }
+
+    template<class ErrorHandler, class = void>
+    struct checks_thread_affinity : std::false_type {
+    };
+
+    template<class ErrorHandler>
+    struct checks_thread_affinity<ErrorHandler, std::enable_if_t<ErrorHandler::check_thread_affinity>>
+            : std::true_type {
+    };
+
+    template<class ErrorHandler, class = void>
+    struct defers_ref_counts : std::false_type {
+    };
+
+    template<class ErrorHandler>
+    struct defers_ref_counts<ErrorHandler, std::enable_if_t<ErrorHandler::defer_ref_counts>> : std::true_type {
+    };
+
+    template<class ErrorHandler, class = void>
+    struct forbids_zombies : std::false_type {
+    };
+
+    template<class ErrorHandler>
+    struct forbids_zombies<ErrorHandler, std::enable_if_t<ErrorHandler::forbid_zombies>> : std::true_type {
+    };
+
+    /// Returns an identifier for the calling thread that is cheaper to get than std::thread::id
+    inline const void *current_thread() {
+        static thread_local const char tag{};
+        return &tag;
+    }
+}
+
+/// Error handling policy that only checks a sample of dep_ptr dereferences.
+/// One in every Period dereferences on a thread is fully checked, using a cheap thread-local
+/// countdown. Construction is always checked, and moving a dep_ptr makes the next dereference
+/// on the same thread a checked one. Errors are reported through Base.
+/// Note that a dereference of a moved-from dep_ptr that is not sampled is not reported, but will
+/// normally crash with a null pointer access instead.
+template<unsigned Period, class Base = owned_ptr_error_handler>
+struct sampling_error_handler : public Base {
+    static_assert(Period > 0, "the sampling period must be at least 1");
+
+    /// Dereference counts for the calling thread
+    struct statistics {
+        unsigned long long checked{};
+        unsigned long long skipped{};
+    };
+
+    static bool sample() {
+        auto &local = _state;
+        if (local.countdown) {
+            --local.countdown;
+            ++local.stats.skipped;
+            return false;
+        }
+        local.countdown = Period - 1;
+        ++local.stats.checked;
+        return true;
+    }
+
+    static void force_check() {
+        _state.countdown = 0;
+    }
+
+    /// Returns the dereference counts for the calling thread
+    static statistics stats() {
+        return _state.stats;
+    }
+
+    /// Resets the dereference counts for the calling thread
+    static void reset_stats() {
+        _state.stats = {};
+    }
+
+private:
+    struct state {
+        unsigned countdown{};
+        statistics stats{};
+    };
+
+    static inline thread_local state _state{};
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OWNED_PTR_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define OWNED_PTR_NOINLINE __declspec(noinline)
+#else
+#define OWNED_PTR_NOINLINE
+#endif
+
+// When allocation sites are tracked, the functions that create blocks are not inlined, so that
+// their return address is in the code that created the block, and make_owned and try_make_owned
+// are always inlined into that code
+#if defined(OWNED_PTR_TRACK_ALLOCATION_SITES) && (defined(__GNUC__) || defined(__clang__))
+#define OWNED_PTR_SITE_ENTRY OWNED_PTR_NOINLINE
+#define OWNED_PTR_SITE_WRAPPER __attribute__((always_inline))
+#define OWNED_PTR_CALLER __builtin_return_address(0)
+#elif defined(OWNED_PTR_TRACK_ALLOCATION_SITES)
+#error "OWNED_PTR_TRACK_ALLOCATION_SITES needs GCC or Clang"
+#else
+#define OWNED_PTR_SITE_ENTRY
+#define OWNED_PTR_SITE_WRAPPER
+#define OWNED_PTR_CALLER nullptr
+#endif
+
+/// The type independent part of owned_ptr, dep_ptr and dep_ptr_const.
+/// Everything that only deals with the control block at the start of the heap block
+/// (reference counting, the owner marker and freeing the block) is done here, so that it
+/// exists once in the program instead of once per target type. The typed handles are thin
+/// wrappers that add the checks and know where the target object is in the block.
+/// The functions that run once per object lifetime are kept out of line, while the
+/// reference count updates done by dep_ptr copies are small enough to inline.
+class owned_ptr_core {
+public:
+    using Deleter = void (*)(char *);
+
+    /// The control block at the start of every heap block
+    struct control {
+        size_t ref_count{};
+        Deleter deleter{}; //NOLINT
+    };
+
+    /// This is a bit mask for the most significant bit of the reference count.
+    /// It is set when the owned_ptr handle exists.
+    static constexpr size_t owner_marker{1ull << (sizeof(size_t) * 8u - 1u)};
+
+    static control &get_control(char *storage) { // NOLINT
+        return *reinterpret_cast<control *>(storage);
+    }
+
+    static bool has_owner(char *storage) {
+        return get_control(storage).ref_count >= owner_marker;
+    }
+
+    static size_t num_deps(char *storage) {
+        return get_control(storage).ref_count & ~owner_marker;
+    }
+
+    static void add_dep(char *storage) {
+        get_control(storage).ref_count++;
+    }
+
+    static void release_dep(char *storage) {
+        if (!--get_control(storage).ref_count) {
+            free_block(storage);
+        }
+    }
+
+    /// Called when the owner is destroyed. Destroys the target object, and frees the block
+    /// unless there are dependencies left.
+    OWNED_PTR_NOINLINE static void release_owner(char *storage) {
+        auto &control = get_control(storage);
+        if (!control.deleter) {
+            control.ref_count &= ~owner_marker;
+            if (!control.ref_count) {
+                free_block(storage);
+            }
+            return;
+        }
+        // The extra reference keeps the block if the target's destructor releases the last dependency
+        control.ref_count = (control.ref_count & ~owner_marker) + 1;
+        control.deleter(storage);
+        release_dep(storage);
+    }
+
+    OWNED_PTR_NOINLINE static void free_block(char *storage) {
+        free(storage);
+    }
+};
+
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+namespace owned_ptr_detail {
+    /// The control block of owned_ptr blocks when allocation sites are tracked. The size of the
+    /// block, and whether it is a zombie or in a locality slab, are recorded as well, so that the
+    /// site can be updated where the target type is not known.
+    struct site_control : owned_ptr_core::control {
+        allocation_site *site{};
+        size_t block_size{};
+        bool zombie{};
+        bool in_slab{};
+    };
+
+    inline site_control &get_site_control(char *storage) {
+        return *reinterpret_cast<site_control *>(storage);
+    }
+
+    /// Called by the deleter, after the target has been destroyed, so that dependencies released
+    /// by its destructor are not counted. One reference is held by owned_ptr_core::release_owner.
+    inline void site_block_owner_released(char *storage) {
+        auto &control = get_site_control(storage);
+        control.zombie = control.ref_count > 1;
+        site_owner_released(control.site, control.block_size, control.zombie);
+    }
 
-template<typename T, class ErrorHandler = owned_ptr_error_handler>
+    /// Called before `count` references to a block are released, since that may free it. A
+    /// zombie is freed when its last reference is gone, or the one kept by its locality slab.
+    inline void site_block_deps_releasing(char *storage, size_t count) {
+        auto &control = get_site_control(storage);
+        if (control.zombie && control.ref_count - count == (control.in_slab ? 1u : 0u)) {
+            control.zombie = false;
+            site_zombie_freed(control.site, control.block_size);
+        }
+    }
+}
+#endif
+
+namespace owned_ptr_detail {
+    /// The reference count changes of dependencies that have not been applied yet, for error
+    /// handlers that defer them. One table per thread, with an entry per block: the changes to
+    /// a block are summed, and applied when the entry is needed for another block or on a flush.
+    /// Summing is safe, since the count of a block only reaches zero after its last change.
+    /// Once the table of a thread has been destroyed at thread exit, changes are applied directly.
+    class deferred_ref_counts {
+    public:
+        static void add(char *storage, std::ptrdiff_t delta) {
+            auto *t = instance();
+            if (!t) {
+                entry direct{storage, delta};
+                apply(direct);
+                return;
+            }
+            auto &entry = t->entries[slot(storage)];
+            if (entry.storage != storage) {
+                if (entry.storage) {
+                    apply(entry);
+                }
+                entry.storage = storage;
+            }
+            entry.delta += delta;
+        }
+
+        /// Applies all changes recorded by the calling thread
+        static void flush() {
+            if (auto *t = instance()) {
+                t->flush();
+            }
+        }
+
+        /// Applies the changes recorded by the calling thread for one block
+        static void flush(char *storage) {
+            if (auto *t = instance()) {
+                auto &entry = t->entries[slot(storage)];
+                if (entry.storage == storage) {
+                    apply(entry);
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t table_size{64};
+
+        struct entry {
+            char *storage;
+            std::ptrdiff_t delta;
+        };
+
+        struct table {
+            ~table() {
+                _destroyed = true;
+                flush();
+            }
+
+            void flush() {
+                for (auto &entry: entries) {
+                    if (entry.storage) {
+                        apply(entry);
+                    }
+                }
+            }
+
+            entry entries[table_size]{};
+        };
+
+        static size_t slot(char *storage) {
+            return (reinterpret_cast<uintptr_t>(storage) >> 4u) % table_size;
+        }
+
+        /// Returns the table of the calling thread, or nullptr if it has been destroyed. Other
+        /// thread_local objects holding dependencies may be destroyed after it.
+        static table *instance() {
+            if (_destroyed) {
+                return nullptr;
+            }
+            static thread_local table t;
+            return &t;
+        }
+
+        static inline thread_local bool _destroyed{};
+
+        static void apply(entry &entry) {
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+            if (entry.delta < 0) {
+                site_block_deps_releasing(entry.storage, static_cast<size_t>(-entry.delta));
+            }
+#endif
+            auto &count = owned_ptr_core::get_control(entry.storage).ref_count;
+            count += static_cast<size_t>(entry.delta);
+            if (!count) {
+                owned_ptr_core::free_block(entry.storage);
+            }
+            entry = {};
+        }
+    };
+
+    constexpr bool is_constant_evaluated() {
+#if defined(__cpp_lib_is_constant_evaluated)
+        return std::is_constant_evaluated();
+#else
+        return false;
+#endif
+    }
+
+    /// Not constexpr, so calling it makes a failed check in constant evaluation a compile error
+    inline void owned_ptr_check_failed_in_constant_evaluation(const char *reason) {
+        (void) reason;
+    }
+
+    constexpr void constant_check(bool condition, const char *reason) {
+        if (!condition) {
+            owned_ptr_check_failed_in_constant_evaluation(reason);
+        }
+    }
+
+    /// The type independent part of a constant_block: the reference count, and the functions
+    /// that destroy the object and delete the block. Handles only refer to this, so that they can
+    /// be destroyed and copied where the target type is incomplete, as with heap blocks.
+    struct constant_control {
+        using Release = void (*)(constant_control *);
+
+        size_t ref_count{owned_ptr_core::owner_marker};
+        Release destroy_object{};
+        Release delete_block{};
+    };
+
+    /// The block used instead of the heap block in constant evaluation, where the control block
+    /// and the object cannot share untyped storage. Allocated with new, which is allowed for
+    /// transient allocations in C++20 constant evaluation.
+    template<typename T>
+    struct constant_block : constant_control {
+        template<class... Args>
+        OWNED_PTR_CONSTEXPR explicit constant_block(Args &&... args)
+                : constant_control{owned_ptr_core::owner_marker, &destroy, &release}, object{std::forward<Args>(args)...} {}
+
+        OWNED_PTR_CONSTEXPR ~constant_block() {}
+
+        static OWNED_PTR_CONSTEXPR constant_block *from(constant_control *control) {
+            return static_cast<constant_block *>(control);
+        }
+
+        static OWNED_PTR_CONSTEXPR void destroy(constant_control *control) {
+            from(control)->object.~T();
+        }
+
+        static OWNED_PTR_CONSTEXPR void release(constant_control *control) {
+            delete from(control);
+        }
+
+        union {
+            T object;
+        };
+    };
+
+    /// Constant evaluation counterparts of owned_ptr_core::release_owner and release_dep
+    constexpr void release_constant_dep(constant_control *constant) {
+        if (!--constant->ref_count) {
+            constant->delete_block(constant);
+        }
+    }
+
+    constexpr void release_constant_owner(constant_control *constant) {
+        constant->ref_count = (constant->ref_count & ~owned_ptr_core::owner_marker) + 1;
+        constant->destroy_object(constant);
+        release_constant_dep(constant);
+    }
+}
+
+struct owned_ptr_identity;
+
+template<typename T, class ErrorHandler>
 class owned_ptr {
 public:
     /// Creates a new handle and owned object.
     /// Takes the same parameters as the target type's constructor, moves the arguments,
     /// and constructs the target object in-place.
+    /// Throws std::bad_alloc if the allocation fails (or reports an error and aborts, in builds
+    /// without exceptions). If the constructor of the target type throws, the block is freed.
     template<class... Args>
-    explicit owned_ptr(Args &&... args) : _storage{allocate()} {
-        new(_storage) Control{owner_marker, &owned_ptr<T, ErrorHandler>::deleter};
-        new(_storage + control_size()) T{std::forward<Args>(args)...};
+    OWNED_PTR_SITE_ENTRY OWNED_PTR_CONSTEXPR explicit owned_ptr(Args &&... args) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = new Constant{std::forward<Args>(args)...};
+            return;
+        }
+        _storage = allocate_or_fail();
+        construct(_storage, std::forward<Args>(args)...);
+        track_allocation(_storage, OWNED_PTR_CALLER);
     }
 
     /// Creates a new handle and owned object, by copying an existing object of the target type.
     /// \param object The object to copy.
-    explicit owned_ptr(const T &object) : _storage{allocate()} {
-        new(_storage) Control{owner_marker, &owned_ptr<T, ErrorHandler>::deleter};
-        new(_storage + control_size()) T{object};
+    OWNED_PTR_SITE_ENTRY OWNED_PTR_CONSTEXPR explicit owned_ptr(const T &object) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = new Constant{object};
+            return;
+        }
+        _storage = allocate_or_fail();
+        construct(_storage, object);
+        track_allocation(_storage, OWNED_PTR_CALLER);
     }
 
     /// Creates a new handle and owned object, by moving an existing object of the target type.
     /// \param object The object to move from.
-    explicit owned_ptr(T &&object) : _storage{allocate()} {
-        new(_storage) Control{owner_marker, &owned_ptr<T, ErrorHandler>::deleter};
-        new(_storage + control_size()) T{std::move(object)};
+    OWNED_PTR_SITE_ENTRY OWNED_PTR_CONSTEXPR explicit owned_ptr(T &&object) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = new Constant{std::move(object)};
+            return;
+        }
+        _storage = allocate_or_fail();
+        construct(_storage, std::move(object));
+        track_allocation(_storage, OWNED_PTR_CALLER);
+    }
+
+    /// Creates a new handle and owned object without failing on allocation failure.
+    /// Returns an empty handle (equal to nullptr, like a moved-from one) if the allocation fails.
+    /// Exceptions from the constructor of the target type are passed on, after freeing the block.
+    template<class... Args>
+    [[nodiscard]] OWNED_PTR_SITE_ENTRY static owned_ptr try_create(Args &&... args) {
+        auto *storage = allocate();
+        if (storage) {
+            construct(storage, std::forward<Args>(args)...);
+            track_allocation(storage, OWNED_PTR_CALLER);
+        }
+        return owned_ptr{adopt_tag{}, storage};
     }
 
     /// Copy constructor (deleted)
     owned_ptr(const owned_ptr &other) = delete;
 
+    /// Creates a new handle and owned object that is a copy of this handle's object.
+    /// Trivially copyable objects are copied with memcpy.
+    [[nodiscard]] OWNED_PTR_SITE_ENTRY owned_ptr clone() const {
+        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
+        auto *storage = allocate_or_fail();
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            construct_control(storage);
+            std::memcpy(storage + control_size(), _storage + control_size(), sizeof(T));
+        } else {
+            construct(storage, get_target(_storage));
+        }
+        track_allocation(storage, OWNED_PTR_CALLER);
+        return owned_ptr{adopt_tag{}, storage};
+    }
+
     /// Copy assignment operator (deleted)
     owned_ptr &operator=(const owned_ptr &other) = delete;
 
     /// Move constructor
-    owned_ptr(owned_ptr &&other) noexcept: _storage(other._storage) {
+    OWNED_PTR_CONSTEXPR owned_ptr(owned_ptr &&other) noexcept {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = other._constant;
+            other._constant = nullptr;
+            return;
+        }
+        _storage = other._storage;
         other._storage = nullptr;
     }
 
     /// Move assignment
-    owned_ptr &operator=(owned_ptr &&other) noexcept {
+    OWNED_PTR_CONSTEXPR owned_ptr &operator=(owned_ptr &&other) noexcept {
         swap(*this, other);
         return *this;
     }
@@ -84,209 +630,497 @@ public:
     /// Destructor.
     /// The owned object is destroyed, but the _storage block on the heap that contains
     /// the reference count, deleter function and the object's memory is retained
-    /// until the last dependency is destroyed.
-    ~owned_ptr() {
+    /// until the last dependency is destroyed. If the error handler forbids zombies, remaining
+    /// dependencies are reported as an error instead.
+    OWNED_PTR_CONSTEXPR ~owned_ptr() {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            if (_constant) {
+                owned_ptr_detail::release_constant_owner(_constant);
+            }
+            return;
+        }
         if (_storage) {
-            ref_count() = ref_count() & ~owner_marker;
-            get_deleter(_storage)(_storage);
-            if (!ref_count()) {
-                delete_block(_storage);
+            if constexpr (counts_deferred) {
+                owned_ptr_detail::deferred_ref_counts::flush(_storage);
             }
+            if constexpr (zombies_forbidden) {
+                ErrorHandler::check_condition(!owned_ptr_core::num_deps(_storage),
+                                              "owned_ptr destroyed while dependencies exist");
+            }
+            if (thread_checked && owned_ptr_core::num_deps(_storage)) {
+                check_thread(_storage);
+            }
+            owned_ptr_core::release_owner(_storage);
         }
     }
 
     /// Creates a dependency pointer
-    auto make_dep() {
+    OWNED_PTR_CONSTEXPR auto make_dep() {
         return dep_ptr<T, ErrorHandler>{*this};
     }
 
     /// Creates a dependency pointer
-    auto make_dep() const {
+    OWNED_PTR_CONSTEXPR auto make_dep() const {
         return dep_ptr_const<T, ErrorHandler>{*this};
     }
 
-    operator T *() { // NOLINT
-        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
-        return &get_target(_storage);
+    OWNED_PTR_CONSTEXPR operator T *() { // NOLINT
+        return target();
     }
 
-    operator const T *() const { // NOLINT
-        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
-        return &get_target(_storage);
+    OWNED_PTR_CONSTEXPR operator const T *() const { // NOLINT
+        return target();
     }
 
-    T *operator->() { // NOLINT
-        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
-        return &get_target(_storage);
+    OWNED_PTR_CONSTEXPR T *operator->() { // NOLINT
+        return target();
     }
 
-    const T *operator->() const { // NOLINT
-        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
-        return &get_target(_storage);
+    OWNED_PTR_CONSTEXPR const T *operator->() const { // NOLINT
+        return target();
     }
 
     /// Returns the number of dependencies
-    [[nodiscard]] size_t num_deps() const { return ref_count() & ~owner_marker; }
+    [[nodiscard]] OWNED_PTR_CONSTEXPR size_t num_deps() const {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            return _constant->ref_count & ~owned_ptr_core::owner_marker;
+        }
+        if constexpr (counts_deferred) {
+            owned_ptr_detail::deferred_ref_counts::flush(_storage);
+        }
+        return owned_ptr_core::num_deps(_storage);
+    }
+
+    /// Makes the calling thread the one that the object and its dependencies belong to.
+    /// Only has an effect if the error handler checks thread affinity, and must only be used when
+    /// handing the object over to another thread with proper synchronization.
+    void transfer_to_current_thread() {
+        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
+        set_thread(_storage);
+    }
 
 private:
-    using Deleter = void (*)(char *);
+    using Control = owned_ptr_core::control;
 
-    struct Control {
-        size_t ref_count{};
-        Deleter deleter{}; //NOLINT
+    struct adopt_tag {
+    };
 
-        bool has_owner() {
-            return ref_count >= owner_marker;
-        }
+    /// Takes over a block that has already been initialized
+    owned_ptr(adopt_tag, char *storage) : _storage{storage} {}
+
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+    using SiteControl = owned_ptr_detail::site_control;
+#else
+    using SiteControl = Control;
+#endif
+
+    /// Control block that also records the thread the object belongs to.
+    /// Only used if the error handler checks thread affinity.
+    struct ThreadControl : SiteControl {
+        const void *thread{};
     };
 
-    /// This is a bit mask for the most significant bit of the reference count.
-    /// It is set when the owned_ptr handle exists.
-    static constexpr size_t owner_marker{1ull << (sizeof(size_t) * 8u - 1u)};
+    static constexpr bool thread_checked{owned_ptr_detail::checks_thread_affinity<ErrorHandler>::value};
+
+    using BlockControl = std::conditional_t<thread_checked, ThreadControl, SiteControl>;
+
+    static constexpr bool zombies_forbidden{owned_ptr_detail::forbids_zombies<ErrorHandler>::value};
 
-    char *_storage;
+    static constexpr bool counts_deferred{owned_ptr_detail::defers_ref_counts<ErrorHandler>::value};
+
+    using Constant = owned_ptr_detail::constant_block<T>;
+
+    union {
+        char *_storage;
+        owned_ptr_detail::constant_control *_constant; // Used instead of _storage in constant evaluation
+    };
+
+    OWNED_PTR_CONSTEXPR T *target() const {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            owned_ptr_detail::constant_check(_constant, "owned_ptr has been moved from");
+            return &Constant::from(_constant)->object;
+        }
+        ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
+        return &get_target(_storage);
+    }
+
+    /// Adds a dependency, or records it when reference counts are deferred
+    static void add_dep(char *storage) {
+        if constexpr (counts_deferred) {
+            owned_ptr_detail::deferred_ref_counts::add(storage, 1);
+        } else {
+            owned_ptr_core::add_dep(storage);
+        }
+    }
+
+    /// Releases a dependency. Without zombies, only the owner frees blocks.
+    static void release_dep(char *storage) {
+        if constexpr (counts_deferred) {
+            owned_ptr_detail::deferred_ref_counts::add(storage, -1);
+            return;
+        }
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+        owned_ptr_detail::site_block_deps_releasing(storage, 1);
+#endif
+        if constexpr (zombies_forbidden) {
+            --owned_ptr_core::get_control(storage).ref_count;
+        } else {
+            owned_ptr_core::release_dep(storage);
+        }
+    }
 
     static void deleter(char *storage) {
         get_target(storage).~T();
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+        owned_ptr_detail::site_block_owner_released(storage);
+#endif
+#ifdef OWNED_PTR_POISON_ZOMBIES
+        // One of the references is held by owned_ptr_core::release_owner during destruction
+        if (get_control(storage).ref_count > 1) {
+            owned_ptr_detail::poison_memory(storage + control_size(), data_alloc_size());
+        }
+#endif
+    }
+
+    /// The deleter of blocks in a locality slab (see relocate_for_locality). Destroys the target
+    /// and keeps one reference, so that the block is never passed to free(). The slab is freed
+    /// once that is the only reference left in each of its blocks.
+    static void slab_deleter(char *storage) {
+        if constexpr (has_deleter()) {
+            deleter(storage);
+        }
+        ++get_control(storage).ref_count;
+    }
+
+    /// Makes a block in a locality slab use slab_deleter
+    static void set_slab_deleter(char *storage) {
+        get_control(storage).deleter = &slab_deleter;
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+        get_control(storage).in_slab = true;
+#endif
     }
 
     static constexpr size_t alignment() {
-        return std::alignment_of<T>::value > std::alignment_of<max_align_t>::value ? std::alignment_of<T>::value
-                                                                                   : std::alignment_of<max_align_t>::value;
+        return std::alignment_of<T>::value > std::alignment_of<std::max_align_t>::value ? std::alignment_of<T>::value
+                                                                                   : std::alignment_of<std::max_align_t>::value;
     }
 
     static constexpr size_t control_size() {
-        return sizeof(Control) > std::alignment_of<T>::value ? sizeof(Control) : std::alignment_of<T>::value;
+        const auto align = std::alignment_of<T>::value;
+        return ((sizeof(BlockControl) + align - 1) / align) * align;
     }
 
     static constexpr size_t data_alloc_size() {
-        const auto align = std::alignment_of<max_align_t>::value;
+        const auto align = std::alignment_of<std::max_align_t>::value;
         return ((sizeof(T) + align - 1) / align) * align;
     }
 
     static constexpr size_t block_size() {
-        return control_size() + data_alloc_size();
+        const auto align = alignment();
+        return ((control_size() + data_alloc_size() + align - 1) / align) * align;
     }
 
     static char* allocate() {
         return static_cast<char*>(aligned_alloc(alignment(), block_size()));
     }
 
-    static Control &get_control(char *storage) { // NOLINT
-        return *reinterpret_cast<Control *>(storage);
+    static char *allocate_or_fail() {
+        auto *storage = allocate();
+        if (!storage) {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+            throw std::bad_alloc{};
+#else
+            ErrorHandler::check_condition(false, "out of memory");
+            std::abort();
+#endif
+        }
+        return storage;
     }
 
-    static T &get_target(char *storage) { // NOLINT
-        return *reinterpret_cast<T *>(storage + control_size());
+    /// Records the allocation site of a new block, when allocation sites are tracked
+    static void track_allocation(char *storage, const void *caller) {
+#ifdef OWNED_PTR_TRACK_ALLOCATION_SITES
+        get_control(storage).site = owned_ptr_detail::allocation_site_registry::find(caller);
+        get_control(storage).block_size = block_size();
+        owned_ptr_detail::site_allocated(get_control(storage).site, block_size());
+#else
+        (void) storage;
+        (void) caller;
+#endif
     }
 
-    static Deleter get_deleter(char *storage) {
-        return *get_control(storage).deleter;
+    /// Initializes the control block and constructs the target object in a new block.
+    /// The block is freed if the constructor throws.
+    template<class... Args>
+    static void construct(char *storage, Args &&... args) {
+        construct_control(storage);
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        try {
+            new(storage + control_size()) T{std::forward<Args>(args)...};
+        } catch (...) {
+            owned_ptr_core::free_block(storage);
+            throw;
+        }
+#else
+        new(storage + control_size()) T{std::forward<Args>(args)...};
+#endif
     }
 
-    static void delete_block(char *storage) {
-        get_control(storage).~Control();
-        free(storage);
+    static BlockControl &get_control(char *storage) { // NOLINT
+        return *reinterpret_cast<BlockControl *>(storage);
+    }
+
+    static void construct_control(char *storage) {
+        new(storage) BlockControl{};
+        get_control(storage).ref_count = owned_ptr_core::owner_marker;
+        get_control(storage).deleter = has_deleter() ? &owned_ptr<T, ErrorHandler>::deleter : nullptr;
+        set_thread(storage);
+    }
+
+    static void set_thread(char *storage) {
+        if constexpr (thread_checked) {
+            get_control(storage).thread = owned_ptr_detail::current_thread();
+        }
+    }
+
+    static void check_thread(char *storage) {
+        if constexpr (thread_checked) {
+            ErrorHandler::check_condition(get_control(storage).thread == owned_ptr_detail::current_thread(),
+                                          "dependency used on a thread the object does not belong to");
+        }
+    }
+
+    static T &get_target(char *storage) { // NOLINT
+        return *reinterpret_cast<T *>(storage + control_size());
+    }
+
+    /// Trivially destructible types get no deleter, which saves the indirect call on destruction.
+    /// Zombie poisoning is done by the deleter, so it is always needed when that is enabled.
+    /// Allocation sites are updated by the deleter, so tracked blocks always have one
+    static constexpr bool has_deleter() {
+#if defined(OWNED_PTR_POISON_ZOMBIES) || defined(OWNED_PTR_TRACK_ALLOCATION_SITES)
+        return true;
+#else
+        return !std::is_trivially_destructible_v<T>;
+#endif
     }
 
-    static void swap(owned_ptr &lhs, owned_ptr &rhs) {
+    static OWNED_PTR_CONSTEXPR void swap(owned_ptr &lhs, owned_ptr &rhs) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            std::swap(lhs._constant, rhs._constant);
+            return;
+        }
         std::swap(lhs._storage, rhs._storage);
     }
 
-    size_t &ref_count() const {
-        return *reinterpret_cast<size_t *>(_storage);
-    };
+    const T *identity() const noexcept {
+        return _storage ? reinterpret_cast<const T *>(_storage + control_size()) : nullptr;
+    }
 
     friend class dep_ptr<T, ErrorHandler>;
 
     friend class dep_ptr_const<T, ErrorHandler>;
+
+    friend struct owned_ptr_identity;
+
+    template<class It>
+    friend size_t relocate_for_locality(It first, It last);
 };
 
+/// Applies the reference count changes that the calling thread has deferred, for error handlers
+/// with defer_ref_counts set. Zombie blocks whose last dependency is gone are freed.
+inline void owned_ptr_safepoint() {
+    owned_ptr_detail::deferred_ref_counts::flush();
+}
+
 template<class T, class... Args>
-inline auto make_owned(Args &&... args) {
+OWNED_PTR_SITE_WRAPPER OWNED_PTR_CONSTEXPR inline auto make_owned(Args &&... args) {
     return owned_ptr<T, owned_ptr_error_handler>(std::forward<Args>(args)...);
 }
 
+/// Creates an owned object, or returns an empty handle (equal to nullptr) if the allocation fails.
+/// For builds without exceptions, and code that handles running out of memory.
+template<class T, class... Args>
+[[nodiscard]] OWNED_PTR_SITE_WRAPPER inline auto try_make_owned(Args &&... args) {
+    return owned_ptr<T, owned_ptr_error_handler>::try_create(std::forward<Args>(args)...);
+}
+
+/// Creates count owned objects constructed from the same arguments, and writes their handles to out.
+/// Trivially copyable objects are only constructed once, and then copied with memcpy.
+template<class T, class OutputIt, class... Args>
+OutputIt make_owned_n(OutputIt out, size_t count, const Args &... args) {
+    if (!count) {
+        return out;
+    }
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        auto first = make_owned<T>(args...);
+        for (size_t i = 1; i < count; ++i) {
+            *out++ = first.clone();
+        }
+        *out++ = std::move(first);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            *out++ = make_owned<T>(args...);
+        }
+    }
+    return out;
+}
+
 template<typename T, class ErrorHandler>
 class dep_ptr {
 private:
     using Owner = owned_ptr<T, ErrorHandler>;
 
 public:
-    explicit dep_ptr(Owner &owned) : _storage{
-            owned._storage} {
+    OWNED_PTR_CONSTEXPR explicit dep_ptr(Owner &owned) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = owned._constant;
+            owned_ptr_detail::constant_check(_constant, "owned_ptr has been moved from");
+            _constant->ref_count++;
+            return;
+        }
+        _storage = owned._storage;
         ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
-        Owner::get_control(_storage).ref_count++;
+        Owner::check_thread(_storage);
+        Owner::add_dep(_storage);
     }
 
-    dep_ptr(const dep_ptr &other) : _storage{other._storage} {
-        Owner::get_control(_storage).ref_count++;
+    OWNED_PTR_CONSTEXPR dep_ptr(const dep_ptr &other) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = other._constant;
+            _constant->ref_count++;
+            return;
+        }
+        _storage = other._storage;
+        Owner::check_thread(_storage);
+        Owner::add_dep(_storage);
     }
 
-    dep_ptr &operator=(const dep_ptr &other) {
+    OWNED_PTR_CONSTEXPR dep_ptr &operator=(const dep_ptr &other) {
         dep_ptr tmp(other);
         swap(*this, tmp);
         return *this;
     }
 
-    dep_ptr(dep_ptr &&other) noexcept: _storage{other._storage} {
+    OWNED_PTR_CONSTEXPR dep_ptr(dep_ptr &&other) noexcept {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = other._constant;
+            if (ErrorHandler::reset_when_moved_from) {
+                other._constant = nullptr;
+            } else {
+                _constant->ref_count++;
+            }
+            return;
+        }
+        _storage = other._storage;
+        owned_ptr_detail::force_check<ErrorHandler>();
         if (ErrorHandler::reset_when_moved_from) {
             other._storage = nullptr;
         } else {
-            Owner::get_control(_storage).ref_count++;
+            Owner::check_thread(_storage);
+            Owner::add_dep(_storage);
         }
     }
 
-    dep_ptr &operator=(dep_ptr &&other) noexcept {
+    OWNED_PTR_CONSTEXPR dep_ptr &operator=(dep_ptr &&other) noexcept {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            if (ErrorHandler::reset_when_moved_from) {
+                swap(*this, other);
+            } else if (this != &other) {
+                dep_ptr tmp(other);
+                swap(*this, tmp);
+            }
+            return *this;
+        }
+        owned_ptr_detail::force_check<ErrorHandler>();
         if (ErrorHandler::reset_when_moved_from) {
             swap(*this, other);
         } else if (this != &other) {
             this->_storage = other._storage;
-            Owner::get_control(_storage).ref_count++;
+            Owner::check_thread(_storage);
+            Owner::add_dep(_storage);
         }
         return *this;
     }
 
-    ~dep_ptr() {
-        if (!_storage) {
+    OWNED_PTR_CONSTEXPR ~dep_ptr() {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            if (_constant) {
+                owned_ptr_detail::release_constant_dep(_constant);
+            }
             return;
         }
-        Owner::get_control(_storage).ref_count--;
-        if (!Owner::get_control(_storage).ref_count) {
-            Owner::delete_block(reinterpret_cast<char *>(_storage));
+        if (!_storage) {
+            return;
         }
+        Owner::check_thread(_storage);
+        Owner::release_dep(_storage);
     }
 
-    operator T *() { // NOLINT
-        ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
-        ErrorHandler::check_condition(Owner::get_control(_storage).has_owner(), "owner has been deleted");
-        return &Owner::get_target(_storage);
+    OWNED_PTR_CONSTEXPR operator T *() { // NOLINT
+        return checked_target();
     }
 
-    operator const T *() const { // NOLINT
-        ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
-        ErrorHandler::check_condition(Owner::get_control(_storage).has_owner(), "owner has been deleted");
-        return &Owner::get_target(_storage);
+    OWNED_PTR_CONSTEXPR operator const T *() const { // NOLINT
+        return checked_target();
     }
 
-    T *operator->() { // NOLINT
-        ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
-        ErrorHandler::check_condition(Owner::get_control(_storage).has_owner(), "owner has been deleted");
-        return &Owner::get_target(_storage);
+    OWNED_PTR_CONSTEXPR T *operator->() { // NOLINT
+        return checked_target();
     }
 
-    const T *operator->() const { // NOLINT
+    OWNED_PTR_CONSTEXPR const T *operator->() const { // NOLINT
+        return checked_target();
+    }
+
+    /// Returns true if the owned_ptr that this dependency was created from still exists.
+    /// A moved-from dependency has no owner.
+    [[nodiscard]] OWNED_PTR_CONSTEXPR bool has_owner() const {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            return _constant && _constant->ref_count >= owned_ptr_core::owner_marker;
+        }
+        return _storage && owned_ptr_core::has_owner(_storage);
+    }
+
+    /// Makes the calling thread the one that the object and its dependencies belong to.
+    /// See owned_ptr::transfer_to_current_thread().
+    void transfer_to_current_thread() {
         ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
-        ErrorHandler::check_condition(Owner::get_control(_storage).has_owner(), "owner has been deleted");
-        return &Owner::get_target(_storage);
+        Owner::set_thread(_storage);
     }
 
 private:
-    char *_storage;
+    union {
+        char *_storage;
+        owned_ptr_detail::constant_control *_constant; // Used instead of _storage in constant evaluation
+    };
+
+    OWNED_PTR_CONSTEXPR T *checked_target() const {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            owned_ptr_detail::constant_check(_constant, "dep_ptr has been moved from");
+            owned_ptr_detail::constant_check(has_owner(), "owner has been deleted");
+            return &Owner::Constant::from(_constant)->object;
+        }
+        if (owned_ptr_detail::sample_check<ErrorHandler>()) {
+            ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
+            ErrorHandler::check_condition(owned_ptr_core::has_owner(_storage), "owner has been deleted");
+        }
+        return &Owner::get_target(_storage);
+    }
 
-    static void swap(dep_ptr &lhs, dep_ptr &rhs) {
+    static OWNED_PTR_CONSTEXPR void swap(dep_ptr &lhs, dep_ptr &rhs) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            std::swap(lhs._constant, rhs._constant);
+            return;
+        }
         std::swap(lhs._storage, rhs._storage);
     }
+
+    const T *identity() const noexcept {
+        return _storage ? reinterpret_cast<const T *>(_storage + Owner::control_size()) : nullptr;
+    }
+
+    friend struct owned_ptr_identity;
 };
 
 template<typename T, class ErrorHandler>
@@ -295,67 +1129,321 @@ private:
     using Owner = owned_ptr<T, ErrorHandler>;
 
 public:
-    explicit dep_ptr_const(const Owner &owned) : _storage{owned._storage} {
+    OWNED_PTR_CONSTEXPR explicit dep_ptr_const(const Owner &owned) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = owned._constant;
+            owned_ptr_detail::constant_check(_constant, "owned_ptr has been moved from");
+            _constant->ref_count++;
+            return;
+        }
+        _storage = owned._storage;
         ErrorHandler::check_condition(_storage, "owned_ptr has been moved from");
-        Owner::get_control(_storage).ref_count++;
+        Owner::check_thread(_storage);
+        Owner::add_dep(_storage);
     }
 
-    dep_ptr_const(const dep_ptr_const &other) : _storage{other._storage} {
-        Owner::get_control(_storage).ref_count++;
+    OWNED_PTR_CONSTEXPR dep_ptr_const(const dep_ptr_const &other) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = other._constant;
+            _constant->ref_count++;
+            return;
+        }
+        _storage = other._storage;
+        Owner::check_thread(_storage);
+        Owner::add_dep(_storage);
     }
 
-    dep_ptr_const &operator=(const dep_ptr_const &other) {
+    OWNED_PTR_CONSTEXPR dep_ptr_const &operator=(const dep_ptr_const &other) {
         dep_ptr_const tmp(other);
         swap(*this, tmp);
         return *this;
     }
 
-    dep_ptr_const(dep_ptr_const &&other) noexcept: _storage{other._storage} {
+    OWNED_PTR_CONSTEXPR dep_ptr_const(dep_ptr_const &&other) noexcept {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            _constant = other._constant;
+            if (ErrorHandler::reset_when_moved_from) {
+                other._constant = nullptr;
+            } else {
+                _constant->ref_count++;
+            }
+            return;
+        }
+        _storage = other._storage;
+        owned_ptr_detail::force_check<ErrorHandler>();
         if (ErrorHandler::reset_when_moved_from) {
             other._storage = nullptr;
         } else {
-            Owner::get_control(_storage).ref_count++;
+            Owner::check_thread(_storage);
+            Owner::add_dep(_storage);
         }
     }
 
-    dep_ptr_const &operator=(dep_ptr_const &&other) noexcept {
+    OWNED_PTR_CONSTEXPR dep_ptr_const &operator=(dep_ptr_const &&other) noexcept {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            if (ErrorHandler::reset_when_moved_from) {
+                swap(*this, other);
+            } else if (this != &other) {
+                dep_ptr_const tmp(other);
+                swap(*this, tmp);
+            }
+            return *this;
+        }
+        owned_ptr_detail::force_check<ErrorHandler>();
         if (ErrorHandler::reset_when_moved_from) {
             swap(*this, other);
         } else if (this != &other) {
             this->_storage = other._storage;
-            Owner::get_control(_storage).ref_count++;
+            Owner::check_thread(_storage);
+            Owner::add_dep(_storage);
         }
         return *this;
     }
 
-    ~dep_ptr_const() {
+    OWNED_PTR_CONSTEXPR ~dep_ptr_const() {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            if (_constant) {
+                owned_ptr_detail::release_constant_dep(_constant);
+            }
+            return;
+        }
         if (!_storage) {
             return;
         }
-        Owner::get_control(_storage).ref_count--;
-        if (!Owner::get_control(_storage).ref_count) {
-            Owner::delete_block(reinterpret_cast<char *>(_storage));
+        Owner::check_thread(_storage);
+        Owner::release_dep(_storage);
+    }
+
+    OWNED_PTR_CONSTEXPR operator const T *() const { // NOLINT
+        return checked_target();
+    }
+
+    OWNED_PTR_CONSTEXPR const T *operator->() const { // NOLINT
+        return checked_target();
+    }
+
+    /// Returns true if the owned_ptr that this dependency was created from still exists.
+    /// A moved-from dependency has no owner.
+    [[nodiscard]] OWNED_PTR_CONSTEXPR bool has_owner() const {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            return _constant && _constant->ref_count >= owned_ptr_core::owner_marker;
         }
+        return _storage && owned_ptr_core::has_owner(_storage);
     }
 
-    operator const T *() const { // NOLINT
+    /// Makes the calling thread the one that the object and its dependencies belong to.
+    /// See owned_ptr::transfer_to_current_thread().
+    void transfer_to_current_thread() {
         ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
-        ErrorHandler::check_condition(Owner::get_control(_storage).has_owner(), "owner has been deleted");
-        return &Owner::get_target(_storage);
+        Owner::set_thread(_storage);
     }
 
-    const T *operator->() const { // NOLINT
-        ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
-        ErrorHandler::check_condition(Owner::get_control(_storage).has_owner(), "owner has been deleted");
+private:
+    union {
+        char *_storage;
+        owned_ptr_detail::constant_control *_constant; // Used instead of _storage in constant evaluation
+    };
+
+    OWNED_PTR_CONSTEXPR const T *checked_target() const {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            owned_ptr_detail::constant_check(_constant, "dep_ptr has been moved from");
+            owned_ptr_detail::constant_check(has_owner(), "owner has been deleted");
+            return &Owner::Constant::from(_constant)->object;
+        }
+        if (owned_ptr_detail::sample_check<ErrorHandler>()) {
+            ErrorHandler::check_condition(_storage, "dep_ptr has been moved from");
+            ErrorHandler::check_condition(owned_ptr_core::has_owner(_storage), "owner has been deleted");
+        }
         return &Owner::get_target(_storage);
     }
 
+    static OWNED_PTR_CONSTEXPR void swap(dep_ptr_const &lhs, dep_ptr_const &rhs) {
+        if (owned_ptr_detail::is_constant_evaluated()) {
+            std::swap(lhs._constant, rhs._constant);
+            return;
+        }
+        std::swap(lhs._storage, rhs._storage);
+    }
+
+    const T *identity() const noexcept {
+        return _storage ? reinterpret_cast<const T *>(_storage + Owner::control_size()) : nullptr;
+    }
+
+    friend struct owned_ptr_identity;
+};
+
+/// Identity of a handle, used for comparison and hashing.
+/// This is the address of the target object, computed without any checks, so it is also
+/// available for moved-from handles (nullptr) and for dependencies whose owner is gone.
+/// Since the block is not freed while any handle to it exists, the identity of a handle
+/// cannot be reused by another object while that handle exists.
+struct owned_ptr_identity {
+    template<typename T, class ErrorHandler>
+    static const T *of(const owned_ptr<T, ErrorHandler> &handle) noexcept { return handle.identity(); }
+
+    template<typename T, class ErrorHandler>
+    static const T *of(const dep_ptr<T, ErrorHandler> &handle) noexcept { return handle.identity(); }
+
+    template<typename T, class ErrorHandler>
+    static const T *of(const dep_ptr_const<T, ErrorHandler> &handle) noexcept { return handle.identity(); }
+
+    template<typename T>
+    static const T *of(const T *pointer) noexcept { return pointer; }
+
+    static std::nullptr_t of(std::nullptr_t) noexcept { return nullptr; }
+
+    template<class A, class B>
+    static bool less(const A &lhs, const B &rhs) noexcept {
+        return address(lhs) < address(rhs);
+    }
+
+    template<class P>
+    static size_t hash(const P &handle) noexcept {
+        const auto value = address(handle);
+        return static_cast<size_t>(value ^ (value >> 4u));
+    }
+
 private:
-    char *_storage;
+    template<class P>
+    static std::uintptr_t address(const P &handle) noexcept {
+        return reinterpret_cast<std::uintptr_t>(of(handle));
+    }
+};
 
-    static void swap(dep_ptr_const &lhs, dep_ptr_const &rhs) {
-        std::swap(lhs._storage, rhs._storage);
+namespace owned_ptr_detail {
+    template<class P>
+    struct handle_element {
+    };
+
+    template<typename T, class ErrorHandler>
+    struct handle_element<owned_ptr<T, ErrorHandler>> {
+        using type = T;
+    };
+
+    template<typename T, class ErrorHandler>
+    struct handle_element<dep_ptr<T, ErrorHandler>> {
+        using type = T;
+    };
+
+    template<typename T, class ErrorHandler>
+    struct handle_element<dep_ptr_const<T, ErrorHandler>> {
+        using type = T;
+    };
+
+    template<class P, class = void>
+    struct is_handle : std::false_type {
+    };
+
+    template<class P>
+    struct is_handle<P, std::void_t<typename handle_element<P>::type>> : std::true_type {
+    };
+
+    /// True if B is a handle, a pointer or nullptr that can be compared with a handle to T
+    template<typename T, class B>
+    struct is_comparable_operand : std::bool_constant<
+            std::is_same_v<B, std::nullptr_t> ||
+            (std::is_pointer_v<B> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<B>>, T>)> {
+    };
+
+    template<typename T, typename U, class ErrorHandler>
+    struct is_comparable_operand<T, owned_ptr<U, ErrorHandler>> : std::is_same<T, U> {
+    };
+
+    template<typename T, typename U, class ErrorHandler>
+    struct is_comparable_operand<T, dep_ptr<U, ErrorHandler>> : std::is_same<T, U> {
+    };
+
+    template<typename T, typename U, class ErrorHandler>
+    struct is_comparable_operand<T, dep_ptr_const<U, ErrorHandler>> : std::is_same<T, U> {
+    };
+
+    template<class A, class B, class = void>
+    struct is_comparable_with : std::false_type {
+    };
+
+    template<class A, class B>
+    struct is_comparable_with<A, B, std::void_t<typename handle_element<A>::type>>
+            : is_comparable_operand<typename handle_element<A>::type, B> {
+    };
+
+    template<class A, class B>
+    using enable_comparison = std::enable_if_t<
+            is_comparable_with<A, B>::value || (!is_handle<A>::value && is_comparable_with<B, A>::value), bool>;
+}
+
+template<class A, class B>
+owned_ptr_detail::enable_comparison<A, B> operator==(const A &lhs, const B &rhs) noexcept {
+    return owned_ptr_identity::of(lhs) == owned_ptr_identity::of(rhs);
+}
+
+template<class A, class B>
+owned_ptr_detail::enable_comparison<A, B> operator!=(const A &lhs, const B &rhs) noexcept {
+    return !(lhs == rhs);
+}
+
+template<class A, class B>
+owned_ptr_detail::enable_comparison<A, B> operator<(const A &lhs, const B &rhs) noexcept {
+    return owned_ptr_identity::less(lhs, rhs);
+}
+
+template<class A, class B>
+owned_ptr_detail::enable_comparison<A, B> operator>(const A &lhs, const B &rhs) noexcept {
+    return rhs < lhs;
+}
+
+template<class A, class B>
+owned_ptr_detail::enable_comparison<A, B> operator<=(const A &lhs, const B &rhs) noexcept {
+    return !(rhs < lhs);
+}
+
+template<class A, class B>
+owned_ptr_detail::enable_comparison<A, B> operator>=(const A &lhs, const B &rhs) noexcept {
+    return !(lhs < rhs);
+}
+
+/// Transparent hash for handles and raw pointers to their target type.
+/// Use with owned_ptr_equal for heterogeneous lookup by raw pointer.
+struct owned_ptr_hash {
+    using is_transparent = void;
+
+    template<class P>
+    size_t operator()(const P &handle) const noexcept {
+        return owned_ptr_identity::hash(handle);
     }
 };
 
+/// Transparent equality for handles and raw pointers to their target type
+struct owned_ptr_equal {
+    using is_transparent = void;
+
+    template<class A, class B>
+    bool operator()(const A &lhs, const B &rhs) const noexcept {
+        return owned_ptr_identity::of(lhs) == owned_ptr_identity::of(rhs);
+    }
+};
+
+/// Transparent ordering for handles and raw pointers to their target type
+struct owned_ptr_less {
+    using is_transparent = void;
+
+    template<class A, class B>
+    bool operator()(const A &lhs, const B &rhs) const noexcept {
+        return owned_ptr_identity::less(lhs, rhs);
+    }
+};
+
+namespace std {
+    template<typename T, class ErrorHandler>
+    struct hash<owned_ptr<T, ErrorHandler>> : owned_ptr_hash {
+    };
+
+    template<typename T, class ErrorHandler>
+    struct hash<dep_ptr<T, ErrorHandler>> : owned_ptr_hash {
+    };
+
+    template<typename T, class ErrorHandler>
+    struct hash<dep_ptr_const<T, ErrorHandler>> : owned_ptr_hash {
+    };
+}
+
 #endif //OWNED_PTR_OWNED_PTR_H
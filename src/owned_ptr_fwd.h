@@ -0,0 +1,19 @@
+#ifndef OWNED_PTR_OWNED_PTR_FWD_H
+#define OWNED_PTR_OWNED_PTR_FWD_H
+
+// Forward declarations of the owned_ptr types, without any standard library includes.
+// Enough for declaring functions that take or return handles, and for pointers and
+// references to them. Include owned_ptr.h where the handles are used or stored as members.
+
+struct owned_ptr_error_handler;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class owned_ptr;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class dep_ptr;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class dep_ptr_const;
+
+#endif //OWNED_PTR_OWNED_PTR_FWD_H
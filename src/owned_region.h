@@ -0,0 +1,471 @@
+#ifndef OWNED_PTR_OWNED_REGION_H
+#define OWNED_PTR_OWNED_REGION_H
+
+#include "owned_ptr.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class region_owned_ptr;
+
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class region_dep_ptr;
+
+namespace owned_ptr_detail {
+    /// The start of every block in a region. Contains no absolute addresses, so that it stays
+    /// valid when the region is mapped at another address.
+    struct region_block {
+        owned_ptr_core::control control; // The deleter is never set, since code addresses change
+        size_t size;
+        size_t region_offset; // Distance from the start of the region
+    };
+
+    /// The start of a region
+    struct region_header {
+        std::uint64_t magic;
+        std::uint64_t size;
+        std::uint64_t used;
+        std::uint64_t free_list; // Offset of the first free block, or 0
+        std::ptrdiff_t root;     // A region_owned_ptr
+    };
+
+    constexpr std::uint64_t region_magic{0x6f776e6564726567ull};
+
+    constexpr size_t region_align{alignof(std::max_align_t)};
+
+    constexpr size_t region_round(size_t size) {
+        return ((size + region_align - 1) / region_align) * region_align;
+    }
+
+    constexpr size_t region_data_offset() {
+        return region_round(sizeof(region_block));
+    }
+
+    inline region_block &get_region_block(char *block) {
+        return *reinterpret_cast<region_block *>(block);
+    }
+
+    inline region_header &header_of(char *block) {
+        return *reinterpret_cast<region_header *>(block - get_region_block(block).region_offset);
+    }
+
+    /// Returns a block to the free list of its region
+    inline void region_free(char *block) {
+        auto &header = header_of(block);
+        auto &b = get_region_block(block);
+        b.control.ref_count = header.free_list;
+        header.free_list = b.region_offset;
+    }
+
+    /// Destroys the target of an owner that is released, and frees the block unless there are
+    /// dependencies left. The extra reference keeps the block if T's destructor releases the last one.
+    template<typename T>
+    void region_release_owner(char *block) {
+        auto &control = get_region_block(block).control;
+        control.ref_count = (control.ref_count & ~owned_ptr_core::owner_marker) + 1;
+        reinterpret_cast<T *>(block + region_data_offset())->~T();
+        if (!--control.ref_count) {
+            region_free(block);
+        }
+    }
+
+    inline void region_release_dep(char *block) {
+        if (!--get_region_block(block).control.ref_count) {
+            region_free(block);
+        }
+    }
+
+    /// Allocates a block with room for size bytes of data, or returns nullptr if the region is full.
+    /// Free blocks are reused if they are large enough (first fit).
+    inline char *region_allocate(char *base, size_t size) {
+        auto &header = *reinterpret_cast<region_header *>(base);
+        const auto block_size = region_data_offset() + region_round(size);
+        for (auto *link = &header.free_list; *link;) {
+            auto *block = base + *link;
+            auto &b = get_region_block(block);
+            if (b.size >= block_size) {
+                *link = b.control.ref_count;
+                b.control = {};
+                return block;
+            }
+            link = &b.control.ref_count;
+        }
+        if (header.size - header.used < block_size) {
+            return nullptr;
+        }
+        auto *block = base + header.used;
+        new(block) region_block{{}, block_size, static_cast<size_t>(header.used)};
+        header.used += block_size;
+        return block;
+    }
+
+    /// Creates an object in a new block, or returns nullptr if the region is full.
+    /// The block goes back to the region if the constructor throws.
+    template<typename T, class... Args>
+    char *region_create(char *base, Args &&... args) {
+        static_assert(alignof(T) <= region_align, "over-aligned types are not supported in regions");
+        auto *block = region_allocate(base, sizeof(T));
+        if (!block) {
+            return nullptr;
+        }
+        get_region_block(block).control.ref_count = owned_ptr_core::owner_marker;
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        try {
+            new(block + region_data_offset()) T{std::forward<Args>(args)...};
+        } catch (...) {
+            region_free(block);
+            throw;
+        }
+#else
+        new(block + region_data_offset()) T{std::forward<Args>(args)...};
+#endif
+        return block;
+    }
+
+    /// A pointer stored as the distance from its own address, so that it stays valid when the
+    /// memory that contains it is mapped at another address. 0 is nullptr.
+    class self_relative {
+    public:
+        self_relative() = default;
+
+        self_relative(const self_relative &other) = delete;
+
+        self_relative &operator=(const self_relative &other) = delete;
+
+        [[nodiscard]] char *get() const {
+            return _offset ? reinterpret_cast<char *>(const_cast<self_relative *>(this)) + _offset : nullptr;
+        }
+
+        void set(char *pointer) {
+            _offset = pointer ? pointer - reinterpret_cast<char *>(this) : 0;
+        }
+
+    private:
+        std::ptrdiff_t _offset{};
+    };
+}
+
+/// A memory region, backed by a file or POSIX shared memory, that owned objects can be
+/// allocated in with make_owned(). The objects are accessed through region_owned_ptr and
+/// region_dep_ptr, which store their targets as offsets, as do the control blocks. A graph of
+/// objects in the region therefore stays valid when the region is synced, unmapped and mapped
+/// again, at any address and in any process on the same host. The graph is reached through
+/// the root handle in the region header.
+///
+/// Objects in a region must be relocatable: they may contain plain data and region handles, but
+/// no pointers, references or types that own heap memory (such as std::string).
+/// Destroying the region object only unmaps it. The objects in it stay in the file or shared
+/// memory object, and are destroyed by resetting their owners.
+///
+/// Reference counts are not atomic, so only one process may use a region at a time.
+class owned_region {
+public:
+    owned_region(const owned_region &other) = delete;
+
+    owned_region &operator=(const owned_region &other) = delete;
+
+    owned_region(owned_region &&other) noexcept: _base{other._base}, _size{other._size} {
+        other._base = nullptr;
+    }
+
+    owned_region &operator=(owned_region &&other) noexcept {
+        std::swap(_base, other._base);
+        std::swap(_size, other._size);
+        return *this;
+    }
+
+    ~owned_region() {
+        if (_base) {
+            munmap(_base, _size);
+        }
+    }
+
+    /// Creates (or truncates) a file and maps a new, empty region of the given size in it.
+    /// Check the result with is_open(); errno tells why if it failed.
+    static owned_region create_file(const char *path, size_t size) {
+        return create(open(path, O_RDWR | O_CREAT | O_TRUNC, 0600), size);
+    }
+
+    /// Maps a region that was created with create_file()
+    static owned_region open_file(const char *path) {
+        return attach(open(path, O_RDWR));
+    }
+
+    /// Reserves an anonymous region of the given size. Memory is only committed when it is used.
+    static owned_region reserve(size_t size) {
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            return owned_region{nullptr, 0};
+        }
+        return initialize(owned_region{static_cast<char *>(base), size});
+    }
+
+    /// Creates (or truncates) a POSIX shared memory object with a new, empty region in it
+    static owned_region create_shared_memory(const char *name, size_t size) {
+        return create(shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600), size);
+    }
+
+    /// Maps a region that was created with create_shared_memory()
+    static owned_region open_shared_memory(const char *name) {
+        return attach(shm_open(name, O_RDWR, 0600));
+    }
+
+    [[nodiscard]] bool is_open() const { return _base; }
+
+    /// Creates an object in the region. Returns an empty handle (equal to nullptr) if the
+    /// region is full.
+    template<class T, class ErrorHandler = owned_ptr_error_handler, class... Args>
+    region_owned_ptr<T, ErrorHandler> make_owned(Args &&... args) {
+        ErrorHandler::check_condition(_base, "owned_region is not open");
+        return region_owned_ptr<T, ErrorHandler>{owned_ptr_detail::region_create<T>(_base, std::forward<Args>(args)...)};
+    }
+
+    /// The handle in the region header that the graph is reached through.
+    /// It must always be used with the same target type.
+    template<class T, class ErrorHandler = owned_ptr_error_handler>
+    region_owned_ptr<T, ErrorHandler> &root() {
+        return *reinterpret_cast<region_owned_ptr<T, ErrorHandler> *>(&header().root);
+    }
+
+    /// Writes the region to its file or shared memory object
+    bool sync() {
+        return msync(_base, _size, MS_SYNC) == 0;
+    }
+
+    /// Returns the number of bytes that have been handed out, including freed blocks
+    [[nodiscard]] size_t used() const { return header().used; }
+
+    [[nodiscard]] size_t size() const { return _size; }
+
+private:
+    owned_region(char *base, size_t size) : _base{base}, _size{size} {}
+
+    owned_ptr_detail::region_header &header() const {
+        return *reinterpret_cast<owned_ptr_detail::region_header *>(_base);
+    }
+
+    static owned_region map(int fd, size_t size) {
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            return owned_region{nullptr, 0};
+        }
+        return owned_region{static_cast<char *>(base), size};
+    }
+
+    static owned_region create(int fd, size_t size) {
+        if (fd < 0) {
+            return owned_region{nullptr, 0};
+        }
+        if (ftruncate(fd, static_cast<off_t>(size))) {
+            close(fd);
+            return owned_region{nullptr, 0};
+        }
+        return initialize(map(fd, size));
+    }
+
+    static owned_region initialize(owned_region &&region) {
+        if (region._base) {
+            new(region._base) owned_ptr_detail::region_header{
+                    owned_ptr_detail::region_magic, region._size,
+                    owned_ptr_detail::region_round(sizeof(owned_ptr_detail::region_header)), 0, 0};
+        }
+        return std::move(region);
+    }
+
+    static owned_region attach(int fd) {
+        struct stat st{};
+        if (fd < 0 || fstat(fd, &st) || static_cast<size_t>(st.st_size) < sizeof(owned_ptr_detail::region_header)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return owned_region{nullptr, 0};
+        }
+        auto region = map(fd, static_cast<size_t>(st.st_size));
+        if (region._base && !region.valid()) {
+            return owned_region{nullptr, 0};
+        }
+        return region;
+    }
+
+    /// Checks that the header is one of a region, and that everything it describes is mapped,
+    /// so that a truncated or corrupt file is rejected instead of being accessed out of bounds
+    [[nodiscard]] bool valid() const {
+        const auto &h = header();
+        const auto first_block = owned_ptr_detail::region_round(sizeof(owned_ptr_detail::region_header));
+        return h.magic == owned_ptr_detail::region_magic && h.size <= _size && h.used >= first_block &&
+               h.used <= h.size && h.free_list < h.used;
+    }
+
+    char *_base;
+    size_t _size;
+
+    friend class compressed_heap;
+};
+
+/// The owner of an object in an owned_region. Works like owned_ptr, but is itself relocatable,
+/// so it can be stored in the region (in other objects, or as the root).
+template<typename T, class ErrorHandler>
+class region_owned_ptr {
+public:
+    /// Creates an empty handle
+    region_owned_ptr() = default;
+
+    region_owned_ptr(const region_owned_ptr &other) = delete;
+
+    region_owned_ptr &operator=(const region_owned_ptr &other) = delete;
+
+    region_owned_ptr(region_owned_ptr &&other) noexcept {
+        _block.set(other._block.get());
+        other._block.set(nullptr);
+    }
+
+    region_owned_ptr &operator=(region_owned_ptr &&other) noexcept {
+        auto *block = other._block.get();
+        other._block.set(_block.get());
+        _block.set(block);
+        return *this;
+    }
+
+    /// Destroys the object. The block goes back to the region when the last dependency is gone.
+    ~region_owned_ptr() {
+        if (auto *block = _block.get()) {
+            owned_ptr_detail::region_release_owner<T>(block);
+        }
+    }
+
+    /// Creates a dependency pointer
+    auto make_dep() {
+        return region_dep_ptr<T, ErrorHandler>{*this};
+    }
+
+    operator T *() { // NOLINT
+        ErrorHandler::check_condition(_block.get(), "region_owned_ptr is empty");
+        return get_target(_block.get());
+    }
+
+    operator const T *() const { // NOLINT
+        ErrorHandler::check_condition(_block.get(), "region_owned_ptr is empty");
+        return get_target(_block.get());
+    }
+
+    T *operator->() { // NOLINT
+        return *this;
+    }
+
+    const T *operator->() const { // NOLINT
+        return *this;
+    }
+
+    /// Returns the number of dependencies
+    [[nodiscard]] size_t num_deps() const { return owned_ptr_core::num_deps(_block.get()); }
+
+    friend bool operator==(const region_owned_ptr &handle, std::nullptr_t) { return !handle._block.get(); }
+
+    friend bool operator!=(const region_owned_ptr &handle, std::nullptr_t) { return handle._block.get(); }
+
+private:
+    explicit region_owned_ptr(char *block) {
+        _block.set(block);
+    }
+
+    static T *get_target(char *block) {
+        return reinterpret_cast<T *>(block + owned_ptr_detail::region_data_offset());
+    }
+
+    owned_ptr_detail::self_relative _block;
+
+    friend class owned_region;
+
+    friend class region_dep_ptr<T, ErrorHandler>;
+};
+
+/// A dependency on an object in an owned_region. Works like dep_ptr, and is relocatable.
+template<typename T, class ErrorHandler>
+class region_dep_ptr {
+private:
+    using Owner = region_owned_ptr<T, ErrorHandler>;
+
+public:
+    explicit region_dep_ptr(Owner &owned) {
+        auto *block = owned._block.get();
+        ErrorHandler::check_condition(block, "region_owned_ptr is empty");
+        owned_ptr_core::add_dep(block);
+        _block.set(block);
+    }
+
+    region_dep_ptr(const region_dep_ptr &other) {
+        auto *block = other._block.get();
+        if (block) {
+            owned_ptr_core::add_dep(block);
+        }
+        _block.set(block);
+    }
+
+    region_dep_ptr &operator=(const region_dep_ptr &other) {
+        region_dep_ptr tmp(other);
+        swap(*this, tmp);
+        return *this;
+    }
+
+    region_dep_ptr(region_dep_ptr &&other) noexcept {
+        auto *block = other._block.get();
+        if (ErrorHandler::reset_when_moved_from) {
+            other._block.set(nullptr);
+        } else if (block) {
+            owned_ptr_core::add_dep(block);
+        }
+        _block.set(block);
+    }
+
+    region_dep_ptr &operator=(region_dep_ptr &&other) noexcept {
+        if (ErrorHandler::reset_when_moved_from) {
+            swap(*this, other);
+        } else if (this != &other) {
+            region_dep_ptr tmp(other);
+            swap(*this, tmp);
+        }
+        return *this;
+    }
+
+    ~region_dep_ptr() {
+        if (auto *block = _block.get()) {
+            owned_ptr_detail::region_release_dep(block);
+        }
+    }
+
+    operator T *() const { // NOLINT
+        return checked_target();
+    }
+
+    T *operator->() const { // NOLINT
+        return checked_target();
+    }
+
+    /// Returns true if the owner still exists
+    [[nodiscard]] bool has_owner() const {
+        auto *block = _block.get();
+        return block && owned_ptr_core::has_owner(block);
+    }
+
+private:
+    T *checked_target() const {
+        auto *block = _block.get();
+        ErrorHandler::check_condition(block, "region_dep_ptr has been moved from");
+        ErrorHandler::check_condition(owned_ptr_core::has_owner(block), "owner has been deleted");
+        return Owner::get_target(block);
+    }
+
+    static void swap(region_dep_ptr &lhs, region_dep_ptr &rhs) {
+        auto *block = lhs._block.get();
+        lhs._block.set(rhs._block.get());
+        rhs._block.set(block);
+    }
+
+    owned_ptr_detail::self_relative _block;
+};
+
+#endif //OWNED_PTR_OWNED_REGION_H
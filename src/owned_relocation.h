@@ -0,0 +1,112 @@
+#ifndef OWNED_PTR_OWNED_RELOCATION_H
+#define OWNED_PTR_OWNED_RELOCATION_H
+
+#include "owned_ptr.h"
+
+#include <iterator>
+
+namespace owned_ptr_detail {
+    /// The header of a slab of owned_ptr blocks allocated by relocate_for_locality
+    struct locality_slab {
+        locality_slab *next;
+        size_t count;
+        size_t block_size;
+        size_t first_block; // Offset of the first block from the header
+    };
+
+    /// The slabs that have not been freed yet. Like the reference counts, this is not
+    /// synchronized, so relocation must only be done on one thread at a time.
+    inline locality_slab *locality_slabs{};
+
+    /// A slab block is dead when the reference kept by owned_ptr::slab_deleter is its only one
+    inline bool slab_is_dead(locality_slab *slab) {
+        auto *block = reinterpret_cast<char *>(slab) + slab->first_block;
+        for (size_t i = 0; i < slab->count; ++i, block += slab->block_size) {
+            if (owned_ptr_core::get_control(block).ref_count != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+/// Frees the slabs made by relocate_for_locality in which all objects and dependencies are gone.
+/// Called by relocate_for_locality. Returns the number of slabs that were freed.
+inline size_t release_unused_locality_slabs() {
+    size_t released = 0;
+    for (auto **link = &owned_ptr_detail::locality_slabs; *link;) {
+        auto *slab = *link;
+        if (owned_ptr_detail::slab_is_dead(slab)) {
+            *link = slab->next;
+            free(slab);
+            ++released;
+        } else {
+            link = &slab->next;
+        }
+    }
+    return released;
+}
+
+/// Moves the objects of the owners in [first, last) that have no dependencies into one new,
+/// contiguous slab, in iteration order, and frees their old blocks. Owners with dependencies
+/// are left alone, since the dependencies point to the old blocks.
+///
+/// After a long period of allocation and release, the blocks behind a container of owners
+/// are scattered across the heap. Calling this periodically makes iteration touch consecutive
+/// memory again. Handles behave as before: the slab blocks have the usual control block, and
+/// dependencies can be created from the relocated owners. A slab block is not freed on its own
+/// when its owner and dependencies are gone; the whole slab is freed by a later call (or by
+/// release_unused_locality_slabs) once none of its blocks is in use.
+///
+/// The target type must be nothrow move constructible. Returns the number of relocated objects,
+/// which is 0 if the slab could not be allocated.
+template<class It>
+size_t relocate_for_locality(It first, It last) {
+    using Owner = typename std::iterator_traits<It>::value_type;
+    using T = std::remove_pointer_t<decltype(std::declval<Owner &>().operator->())>;
+    static_assert(std::is_nothrow_move_constructible_v<T>, "relocated objects must be nothrow move constructible");
+
+    release_unused_locality_slabs();
+    size_t count = 0;
+    for (auto it = first; it != last; ++it) {
+        if (it->_storage && !it->num_deps()) {
+            ++count;
+        }
+    }
+    if (!count) {
+        return 0;
+    }
+
+    const auto align = Owner::alignment();
+    const auto block_size = Owner::block_size();
+    const auto first_block = ((sizeof(owned_ptr_detail::locality_slab) + align - 1) / align) * align;
+    auto *slab = static_cast<owned_ptr_detail::locality_slab *>(aligned_alloc(align, first_block + count * block_size));
+    if (!slab) {
+        return 0;
+    }
+    new(slab) owned_ptr_detail::locality_slab{owned_ptr_detail::locality_slabs, count, block_size, first_block};
+    owned_ptr_detail::locality_slabs = slab;
+
+    auto *block = reinterpret_cast<char *>(slab) + first_block;
+    for (auto it = first; it != last; ++it) {
+        auto *old = it->_storage;
+        if (!old || it->num_deps()) {
+            continue;
+        }
+        new(block) typename Owner::BlockControl{Owner::get_control(old)};
+        Owner::set_slab_deleter(block);
+        new(block + Owner::control_size()) T(std::move(Owner::get_target(old)));
+        Owner::get_target(old).~T();
+        if (Owner::get_control(old).deleter == &Owner::slab_deleter) {
+            // Blocks in an earlier slab are marked dead, and freed with the slab
+            Owner::get_control(old).ref_count = 1;
+        } else {
+            owned_ptr_core::free_block(old);
+        }
+        it->_storage = block;
+        block += block_size;
+    }
+    return count;
+}
+
+#endif //OWNED_PTR_OWNED_RELOCATION_H
@@ -0,0 +1,511 @@
+#ifndef OWNED_PTR_OWNED_SOA_H
+#define OWNED_PTR_OWNED_SOA_H
+
+#include "owned_ptr.h"
+
+#include <tuple>
+
+/// A structure-of-arrays container of owned rows.
+///
+/// Each field is stored in its own column, aligned to column_alignment, so that loops over a
+/// column can be vectorized. Rows are created with add(), which returns the owner of the row.
+/// When a row owner is destroyed the row is removed, by moving the last row into its place, so
+/// the columns stay dense.
+///
+/// Rows hand out row_dep dependencies, and the container hands out column_dep dependencies that
+/// view a whole column. Both are checked like dep_ptr: a row_dep reports an error if its row or
+/// the container is gone, and a column_dep reports an error if the container is gone or the
+/// columns have been reallocated or had rows removed since it was created.
+///
+/// The container, rows and dependencies share one control block, which is freed when the last
+/// of them is gone. Fields must be trivially copyable, since rows are moved with plain copies.
+/// Like owned_ptr, nothing here is thread safe.
+template<class ErrorHandler, class... Fields>
+class basic_owned_soa {
+    static_assert(sizeof...(Fields) > 0, "owned_soa needs at least one field");
+    static_assert((std::is_trivially_copyable_v<Fields> && ...), "owned_soa fields must be trivially copyable");
+
+public:
+    static constexpr size_t column_alignment{64};
+
+    template<size_t I>
+    using field_type = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+private:
+    struct slot {
+        size_t ref_count;
+        size_t index; // The row, or the next free slot when unused
+    };
+
+    /// Shared by the container and all handles. The arrays are freed with the container,
+    /// the state itself when the last handle is gone (by owned_ptr_core, so it must be trivial).
+    struct state {
+        owned_ptr_core::control control;
+        void *columns[sizeof...(Fields)];
+        size_t *slot_of;
+        slot *slots;
+        size_t size;
+        size_t capacity;
+        size_t num_slots;
+        size_t slot_capacity;
+        size_t free_slot;
+        size_t version;
+    };
+
+    static constexpr size_t no_slot{~size_t{0}};
+
+public:
+    class row_dep;
+
+    /// The owner of a row. The row is removed from the container when this is destroyed.
+    class row {
+    public:
+        row(const row &other) = delete;
+
+        row &operator=(const row &other) = delete;
+
+        row(row &&other) noexcept: _state{other._state}, _slot{other._slot} {
+            other._state = nullptr;
+        }
+
+        row &operator=(row &&other) noexcept {
+            std::swap(_state, other._state);
+            std::swap(_slot, other._slot);
+            return *this;
+        }
+
+        ~row() {
+            if (!_state) {
+                return;
+            }
+            if (alive(_state)) {
+                remove_row(_state, _state->slots[_slot].index);
+                release_slot(_state, _slot, owned_ptr_core::owner_marker);
+            }
+            owned_ptr_core::release_dep(block(_state));
+        }
+
+        template<size_t I>
+        field_type<I> &get() {
+            return column<I>(_state)[index()];
+        }
+
+        template<size_t I>
+        const field_type<I> &get() const {
+            return column<I>(_state)[index()];
+        }
+
+        /// Returns the current position of the row in the columns.
+        /// Changes when other rows are removed.
+        [[nodiscard]] size_t index() const {
+            ErrorHandler::check_condition(_state, "owned_soa row has been moved from");
+            ErrorHandler::check_condition(alive(_state), "owned_soa has been deleted");
+            return _state->slots[_slot].index;
+        }
+
+        /// Creates a dependency pointer to the row
+        [[nodiscard]] row_dep make_dep() const {
+            ErrorHandler::check_condition(_state, "owned_soa row has been moved from");
+            ErrorHandler::check_condition(alive(_state), "owned_soa has been deleted");
+            return row_dep{_state, _slot};
+        }
+
+        /// Returns the number of dependencies
+        [[nodiscard]] size_t num_deps() const {
+            if (!alive(_state)) {
+                return 0;
+            }
+            return _state->slots[_slot].ref_count & ~owned_ptr_core::owner_marker;
+        }
+
+    private:
+        row(state *s, size_t id) : _state{s}, _slot{id} {}
+
+        state *_state;
+        size_t _slot;
+
+        friend class basic_owned_soa;
+    };
+
+    /// A dependency on a row
+    class row_dep {
+    public:
+        row_dep(const row_dep &other) : _state{other._state}, _slot{other._slot} {
+            add_ref();
+        }
+
+        row_dep &operator=(const row_dep &other) {
+            row_dep tmp(other);
+            swap(*this, tmp);
+            return *this;
+        }
+
+        row_dep(row_dep &&other) noexcept: _state{other._state}, _slot{other._slot} {
+            if (ErrorHandler::reset_when_moved_from) {
+                other._state = nullptr;
+            } else {
+                add_ref();
+            }
+        }
+
+        row_dep &operator=(row_dep &&other) noexcept {
+            if (ErrorHandler::reset_when_moved_from) {
+                swap(*this, other);
+            } else if (this != &other) {
+                row_dep tmp(other);
+                swap(*this, tmp);
+            }
+            return *this;
+        }
+
+        ~row_dep() {
+            if (!_state) {
+                return;
+            }
+            if (alive(_state)) {
+                release_slot(_state, _slot, 1);
+            }
+            owned_ptr_core::release_dep(block(_state));
+        }
+
+        template<size_t I>
+        field_type<I> &get() const {
+            ErrorHandler::check_condition(_state, "owned_soa row_dep has been moved from");
+            ErrorHandler::check_condition(alive(_state), "owned_soa has been deleted");
+            const auto &s = _state->slots[_slot];
+            ErrorHandler::check_condition(s.ref_count >= owned_ptr_core::owner_marker, "owner has been deleted");
+            return column<I>(_state)[s.index];
+        }
+
+        /// Returns true if both the row and the container still exist
+        [[nodiscard]] bool has_owner() const {
+            return _state && alive(_state) && _state->slots[_slot].ref_count >= owned_ptr_core::owner_marker;
+        }
+
+    private:
+        row_dep(state *s, size_t id) : _state{s}, _slot{id} {
+            add_ref();
+        }
+
+        void add_ref() {
+            owned_ptr_core::add_dep(block(_state));
+            if (alive(_state)) {
+                _state->slots[_slot].ref_count++;
+            }
+        }
+
+        static void swap(row_dep &lhs, row_dep &rhs) {
+            std::swap(lhs._state, rhs._state);
+            std::swap(lhs._slot, rhs._slot);
+        }
+
+        state *_state;
+        size_t _slot;
+
+        friend class row;
+    };
+
+    /// A dependency on a whole column, for kernels that loop over it.
+    /// Check once with data(), begin() or end() and then loop over the raw pointers.
+    template<size_t I>
+    class column_dep {
+    public:
+        column_dep(const column_dep &other) :
+                _state{other._state}, _version{other._version}, _data{other._data}, _size{other._size} {
+            owned_ptr_core::add_dep(block(_state));
+        }
+
+        column_dep &operator=(const column_dep &other) {
+            column_dep tmp(other);
+            swap(*this, tmp);
+            return *this;
+        }
+
+        column_dep(column_dep &&other) noexcept:
+                _state{other._state}, _version{other._version}, _data{other._data}, _size{other._size} {
+            if (ErrorHandler::reset_when_moved_from) {
+                other._state = nullptr;
+            } else {
+                owned_ptr_core::add_dep(block(_state));
+            }
+        }
+
+        column_dep &operator=(column_dep &&other) noexcept {
+            if (ErrorHandler::reset_when_moved_from) {
+                swap(*this, other);
+            } else if (this != &other) {
+                column_dep tmp(other);
+                swap(*this, tmp);
+            }
+            return *this;
+        }
+
+        ~column_dep() {
+            if (_state) {
+                owned_ptr_core::release_dep(block(_state));
+            }
+        }
+
+        field_type<I> *data() const {
+            ErrorHandler::check_condition(_state, "owned_soa column_dep has been moved from");
+            ErrorHandler::check_condition(alive(_state), "owned_soa has been deleted");
+            ErrorHandler::check_condition(_state->version == _version, "owned_soa columns have changed");
+            return _data;
+        }
+
+        field_type<I> *begin() const { return data(); }
+
+        field_type<I> *end() const { return data() + _size; }
+
+        /// Returns the number of rows at the time the dependency was created
+        [[nodiscard]] size_t size() const { return _size; }
+
+        /// Returns true if the container exists and the column has not changed
+        [[nodiscard]] bool has_owner() const {
+            return _state && alive(_state) && _state->version == _version;
+        }
+
+    private:
+        explicit column_dep(state *s) :
+                _state{s}, _version{s->version}, _data{column<I>(s)}, _size{s->size} {
+            owned_ptr_core::add_dep(block(_state));
+        }
+
+        static void swap(column_dep &lhs, column_dep &rhs) {
+            std::swap(lhs._state, rhs._state);
+            std::swap(lhs._version, rhs._version);
+            std::swap(lhs._data, rhs._data);
+            std::swap(lhs._size, rhs._size);
+        }
+
+        state *_state;
+        size_t _version;
+        field_type<I> *_data;
+        size_t _size;
+
+        friend class basic_owned_soa;
+    };
+
+    /// Creates an empty container.
+    /// Throws std::bad_alloc if an allocation fails here or in add() (or reports an error and
+    /// aborts, in builds without exceptions). The container is unchanged by a failed add().
+    /// \param capacity The number of rows to allocate space for up front.
+    explicit basic_owned_soa(size_t capacity = 0) : _state{static_cast<state *>(malloc(sizeof(state)))} {
+        if (!_state) {
+            allocation_failed();
+        }
+        new(_state) state{};
+        _state->control.ref_count = owned_ptr_core::owner_marker;
+        _state->free_slot = no_slot;
+        if (capacity) {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+            try {
+                grow(capacity);
+            } catch (...) {
+                free(_state);
+                throw;
+            }
+#else
+            grow(capacity);
+#endif
+        }
+    }
+
+    basic_owned_soa(const basic_owned_soa &other) = delete;
+
+    basic_owned_soa &operator=(const basic_owned_soa &other) = delete;
+
+    basic_owned_soa(basic_owned_soa &&other) noexcept: _state{other._state} {
+        other._state = nullptr;
+    }
+
+    basic_owned_soa &operator=(basic_owned_soa &&other) noexcept {
+        std::swap(_state, other._state);
+        return *this;
+    }
+
+    /// Destroys all rows. Row owners and dependencies that remain report has_owner() == false.
+    ~basic_owned_soa() {
+        if (!_state) {
+            return;
+        }
+        for (auto *column: _state->columns) {
+            free(column);
+        }
+        free(_state->slot_of);
+        free(_state->slots);
+        owned_ptr_core::release_owner(block(_state));
+    }
+
+    /// Adds a row and returns its owner
+    [[nodiscard]] row add(const Fields &... values) {
+        ErrorHandler::check_condition(_state, "owned_soa has been moved from");
+        // Everything that can fail is done before the columns are changed
+        reserve_slot();
+        if (_state->size == _state->capacity) {
+            grow(_state->capacity ? _state->capacity * 2 : 16);
+        }
+        const auto index = _state->size;
+        store(index, std::index_sequence_for<Fields...>{}, values...);
+        const auto id = acquire_slot();
+        _state->slots[id] = slot{owned_ptr_core::owner_marker, index};
+        _state->slot_of[index] = id;
+        _state->size++;
+        owned_ptr_core::add_dep(block(_state));
+        return row{_state, id};
+    }
+
+    /// Returns the number of rows
+    [[nodiscard]] size_t size() const {
+        ErrorHandler::check_condition(_state, "owned_soa has been moved from");
+        return _state->size;
+    }
+
+    /// Returns column I for direct use by the container's owner, aligned to column_alignment.
+    /// The pointer is invalidated by add() and by removal of rows.
+    template<size_t I>
+    field_type<I> *column() {
+        ErrorHandler::check_condition(_state, "owned_soa has been moved from");
+        return column<I>(_state);
+    }
+
+    template<size_t I>
+    const field_type<I> *column() const {
+        ErrorHandler::check_condition(_state, "owned_soa has been moved from");
+        return column<I>(_state);
+    }
+
+    /// Creates a dependency on column I, covering the current rows
+    template<size_t I>
+    [[nodiscard]] column_dep<I> make_column_dep() const {
+        ErrorHandler::check_condition(_state, "owned_soa has been moved from");
+        return column_dep<I>{_state};
+    }
+
+private:
+    state *_state;
+
+    static char *block(state *s) {
+        return reinterpret_cast<char *>(s);
+    }
+
+    static bool alive(state *s) {
+        return owned_ptr_core::has_owner(block(s));
+    }
+
+    template<size_t I>
+    static field_type<I> *column(state *s) {
+        auto *data = static_cast<field_type<I> *>(s->columns[I]);
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<field_type<I> *>(__builtin_assume_aligned(data, column_alignment));
+#else
+        return data;
+#endif
+    }
+
+    template<class F, size_t... I>
+    static void for_each_column(F &&f, std::index_sequence<I...>) {
+        (f(std::integral_constant<size_t, I>{}), ...);
+    }
+
+    template<size_t... I>
+    void store(size_t index, std::index_sequence<I...>, const Fields &... values) {
+        ((column<I>(_state)[index] = values), ...);
+    }
+
+    [[noreturn]] static void allocation_failed() {
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        throw std::bad_alloc{};
+#else
+        ErrorHandler::check_condition(false, "out of memory");
+        std::abort();
+#endif
+    }
+
+    /// Moves the columns to larger arrays. Everything is allocated before anything is changed,
+    /// so the container is left as it was if an allocation fails.
+    void grow(size_t capacity) {
+        auto *s = _state;
+        void *columns[sizeof...(Fields)]{};
+        bool allocated = true;
+        for_each_column([&](auto i) {
+            constexpr size_t I = decltype(i)::value;
+            const auto bytes = ((capacity * sizeof(field_type<I>) + column_alignment - 1) / column_alignment) *
+                               column_alignment;
+            columns[I] = allocated ? aligned_alloc(column_alignment, bytes) : nullptr;
+            allocated = allocated && columns[I];
+        }, std::index_sequence_for<Fields...>{});
+        auto *slot_of = allocated ? static_cast<size_t *>(realloc(s->slot_of, capacity * sizeof(size_t))) : nullptr;
+        if (!slot_of) {
+            for (auto *column: columns) {
+                free(column);
+            }
+            allocation_failed();
+        }
+        s->slot_of = slot_of;
+        for_each_column([&](auto i) {
+            constexpr size_t I = decltype(i)::value;
+            if (s->size) {
+                std::memcpy(columns[I], s->columns[I], s->size * sizeof(field_type<I>));
+            }
+            free(s->columns[I]);
+            s->columns[I] = columns[I];
+        }, std::index_sequence_for<Fields...>{});
+        s->capacity = capacity;
+        s->version++;
+    }
+
+    /// Makes sure that acquire_slot() will not need to allocate
+    void reserve_slot() {
+        auto *s = _state;
+        if (s->free_slot == no_slot && s->num_slots == s->slot_capacity) {
+            const auto slot_capacity = s->slot_capacity ? s->slot_capacity * 2 : 16;
+            auto *slots = static_cast<slot *>(realloc(s->slots, slot_capacity * sizeof(slot)));
+            if (!slots) {
+                allocation_failed();
+            }
+            s->slots = slots;
+            s->slot_capacity = slot_capacity;
+        }
+    }
+
+    size_t acquire_slot() {
+        auto *s = _state;
+        if (s->free_slot != no_slot) {
+            const auto id = s->free_slot;
+            s->free_slot = s->slots[id].index;
+            return id;
+        }
+        return s->num_slots++;
+    }
+
+    /// Moves the last row into the place of the removed one
+    static void remove_row(state *s, size_t index) {
+        const auto last = s->size - 1;
+        if (index != last) {
+            for_each_column([&](auto i) {
+                constexpr size_t I = decltype(i)::value;
+                column<I>(s)[index] = column<I>(s)[last];
+            }, std::index_sequence_for<Fields...>{});
+            s->slot_of[index] = s->slot_of[last];
+            s->slots[s->slot_of[index]].index = index;
+        }
+        s->size--;
+        s->version++;
+    }
+
+    /// Drops count references to a slot, and makes it reusable when none remain
+    static void release_slot(state *s, size_t id, size_t count) {
+        auto &released = s->slots[id];
+        released.ref_count -= count;
+        if (!released.ref_count) {
+            released.index = s->free_slot;
+            s->free_slot = id;
+        }
+    }
+};
+
+template<class... Fields>
+using owned_soa = basic_owned_soa<owned_ptr_error_handler, Fields...>;
+
+#endif //OWNED_PTR_OWNED_SOA_H
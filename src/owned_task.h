@@ -0,0 +1,285 @@
+#ifndef OWNED_PTR_OWNED_TASK_H
+#define OWNED_PTR_OWNED_TASK_H
+
+#include "owned_ptr.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error "owned_task.h requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+
+namespace owned_ptr_detail {
+    template<class A, class = void>
+    struct has_member_co_await : std::false_type {
+    };
+
+    template<class A>
+    struct has_member_co_await<A, std::void_t<decltype(std::declval<A>().operator co_await())>>
+            : std::true_type {
+    };
+
+    template<class A, class = void>
+    struct has_free_co_await : std::false_type {
+    };
+
+    template<class A>
+    struct has_free_co_await<A, std::void_t<decltype(operator co_await(std::declval<A>()))>> : std::true_type {
+    };
+
+    /// Returns the awaiter for an awaitable, the same way co_await finds it
+    template<class A>
+    decltype(auto) get_awaiter(A &&awaitable) {
+        if constexpr (has_member_co_await<A>::value) {
+            return std::forward<A>(awaitable).operator co_await();
+        } else if constexpr (has_free_co_await<A>::value) {
+            return operator co_await(std::forward<A>(awaitable));
+        } else {
+            return std::forward<A>(awaitable);
+        }
+    }
+
+    /// A coroutine that sits between an awaiter and the task that awaits it.
+    /// The awaiter resumes the gate instead of the task, and the gate then either resumes the
+    /// task or destroys it if the owner is gone. One gate is created per task, and reused for
+    /// every suspension.
+    class resume_gate {
+    public:
+        using Check = bool (*)(const void *);
+
+        struct promise_type {
+            std::coroutine_handle<> target{};
+            Check alive{};
+            const void *owner{};
+
+            resume_gate get_return_object() {
+                return resume_gate{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            void return_void() {}
+
+            void unhandled_exception() { std::abort(); }
+        };
+
+        resume_gate(const resume_gate &other) = delete;
+
+        resume_gate &operator=(const resume_gate &other) = delete;
+
+        resume_gate(resume_gate &&other) noexcept: _handle{other._handle} {
+            other._handle = nullptr;
+        }
+
+        ~resume_gate() {
+            if (_handle) {
+                _handle.destroy();
+            }
+        }
+
+        /// Creates a gate for the target task. alive(owner) is called on every resumption.
+        static resume_gate create(std::coroutine_handle<> target, Check alive, const void *owner) {
+            auto gate = run();
+            gate._handle.promise().target = target;
+            gate._handle.promise().alive = alive;
+            gate._handle.promise().owner = owner;
+            return gate;
+        }
+
+        [[nodiscard]] std::coroutine_handle<> handle() const { return _handle; }
+
+    private:
+        /// Passes control on to the target task, or destroys it (and with it this gate) if
+        /// the owner has been destroyed
+        struct pass {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+                const auto &promise = self.promise();
+                const auto target = promise.target;
+                if (promise.alive(promise.owner)) {
+                    return target;
+                }
+                target.destroy();
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        static resume_gate run() {
+            for (;;) {
+                co_await pass{};
+            }
+        }
+
+        explicit resume_gate(std::coroutine_handle<promise_type> handle) : _handle{handle} {}
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+}
+
+/// Return type for a fire-and-forget coroutine that is bound to the lifetime of an owned object.
+///
+/// The first parameter of the coroutine must be a dep_ptr to the object. The task starts running
+/// immediately, and every time it is resumed after a co_await it checks that the owner still
+/// exists. If the owner is gone, the task is destroyed instead of resumed: the rest of the body is
+/// skipped and the destructors of its local variables run, just as if it had returned.
+/// This is a single load of the reference count, so no atomics or cancellation tokens are needed,
+/// but it means that the task must be resumed on the thread that the owned object belongs to.
+///
+///     owned_task<Session> handle_reads(dep_ptr<Session> session) {
+///         for (;;) {
+///             auto data = co_await session->socket.read();  // Returns here only if the session exists
+///             session->process(data);
+///         }
+///     }
+///
+/// The first resumption after the owner is gone is the last one. A task that is suspended on
+/// something that never completes is not destroyed, await lifetime_signal::destroyed() for that.
+template<typename T, class ErrorHandler = owned_ptr_error_handler>
+class owned_task {
+public:
+    struct promise_type {
+        template<class... Args>
+        explicit promise_type(const dep_ptr<T, ErrorHandler> &owner, const Args &...) :
+                _owner{owner},
+                _gate{owned_ptr_detail::resume_gate::create(std::coroutine_handle<promise_type>::from_promise(*this),
+                                                            &alive, &_owner)} {
+        }
+
+        owned_task get_return_object() { return {}; }
+
+        /// Does not start the task at all if the owner is already gone
+        auto initial_suspend() noexcept {
+            struct start {
+                bool alive;
+
+                bool await_ready() noexcept { return alive; }
+
+                void await_suspend(std::coroutine_handle<> handle) noexcept { handle.destroy(); }
+
+                void await_resume() noexcept {}
+            };
+            return start{_owner.has_owner()};
+        }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::abort(); }
+
+        template<class A>
+        auto await_transform(A &&awaitable) {
+            using Awaiter = decltype(owned_ptr_detail::get_awaiter(std::forward<A>(awaitable)));
+            return gated<std::conditional_t<std::is_lvalue_reference_v<Awaiter>, Awaiter,
+                    std::remove_reference_t<Awaiter>>>{
+                    owned_ptr_detail::get_awaiter(std::forward<A>(awaitable)), _gate.handle()};
+        }
+
+    private:
+        /// Wraps an awaiter so that it resumes the gate instead of the task
+        template<class Awaiter>
+        struct gated {
+            Awaiter awaiter;
+            std::coroutine_handle<> gate;
+
+            bool await_ready() { return awaiter.await_ready(); }
+
+            auto await_suspend(std::coroutine_handle<>) {
+                return awaiter.await_suspend(gate);
+            }
+
+            decltype(auto) await_resume() { return awaiter.await_resume(); }
+        };
+
+        static bool alive(const void *owner) {
+            return static_cast<const dep_ptr<T, ErrorHandler> *>(owner)->has_owner();
+        }
+
+        dep_ptr<T, ErrorHandler> _owner;
+        owned_ptr_detail::resume_gate _gate;
+    };
+};
+
+/// Lets coroutines wait for an owned object to be destroyed.
+/// Make it a member of the owned type, declared before the other members, so that it is
+/// destroyed after them. Its destructor resumes every waiting coroutine, at which point
+/// has_owner() is already false for all dependencies to the object.
+/// Not thread safe: waiting and destruction must happen on the thread the object belongs to.
+class lifetime_signal {
+public:
+    class awaiter {
+    public:
+        explicit awaiter(lifetime_signal &signal) : _signal{&signal} {}
+
+        awaiter(const awaiter &other) = delete;
+
+        awaiter &operator=(const awaiter &other) = delete;
+
+        /// Only valid before the awaiter is suspended on
+        awaiter(awaiter &&other) noexcept: _signal{other._signal} {
+            other._signal = nullptr;
+        }
+
+        /// Stops waiting if the waiting coroutine is destroyed first
+        ~awaiter() {
+            if (_signal) {
+                _signal->remove(this);
+            }
+        }
+
+        bool await_ready() noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            _handle = handle;
+            _next = _signal->_waiters;
+            _signal->_waiters = this;
+        }
+
+        void await_resume() noexcept {}
+
+    private:
+        lifetime_signal *_signal;
+        std::coroutine_handle<> _handle{};
+        awaiter *_next{};
+
+        friend class lifetime_signal;
+    };
+
+    lifetime_signal() = default;
+
+    lifetime_signal(const lifetime_signal &other) = delete;
+
+    lifetime_signal &operator=(const lifetime_signal &other) = delete;
+
+    ~lifetime_signal() {
+        while (_waiters) {
+            auto *waiter = _waiters;
+            _waiters = waiter->_next;
+            waiter->_signal = nullptr;
+            waiter->_handle.resume();
+        }
+    }
+
+    /// Returns an awaitable that completes when this object is destroyed
+    [[nodiscard]] awaiter destroyed() { return awaiter{*this}; }
+
+private:
+    void remove(awaiter *waiter) {
+        auto **link = &_waiters;
+        while (*link && *link != waiter) {
+            link = &(*link)->_next;
+        }
+        if (*link) {
+            *link = waiter->_next;
+        }
+    }
+
+    awaiter *_waiters{};
+};
+
+#endif //OWNED_PTR_OWNED_TASK_H
@@ -0,0 +1,192 @@
+#ifndef OWNED_PTR_PARALLEL_DEPS_H
+#define OWNED_PTR_PARALLEL_DEPS_H
+
+#include "owned_ptr.h"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Parallel algorithms over ranges of dep_ptr or dep_ptr_const.
+//
+// Dependencies cannot be copied on worker threads, since that would race on the reference
+// counts, and passing raw pointers loses the checks. These algorithms check every dependency
+// once on the calling thread, and give the workers references to the targets (borrows that do
+// not touch the reference counts). Dependencies that fail the check are reported through the
+// error handler and skipped. The dependencies are checked again after the parallel part, to
+// report an owner that was destroyed while the workers were running.
+//
+// The calling thread takes part in the work. threads = 0 uses std::thread::hardware_concurrency().
+
+namespace owned_ptr_detail {
+    template<class Dep>
+    struct dep_traits;
+
+    template<class T, class ErrorHandler>
+    struct dep_traits<dep_ptr<T, ErrorHandler>> {
+        using error_handler = ErrorHandler;
+        using pointer = T *;
+    };
+
+    template<class T, class ErrorHandler>
+    struct dep_traits<dep_ptr_const<T, ErrorHandler>> {
+        using error_handler = ErrorHandler;
+        using pointer = const T *;
+    };
+
+    template<class It>
+    using dep_traits_of = dep_traits<typename std::iterator_traits<It>::value_type>;
+
+    /// A checked dependency, by its position in the range
+    template<class Pointer>
+    struct borrow {
+        size_t index;
+        Pointer target;
+    };
+
+    /// Checks every dependency in [first, last) and returns the targets of those that pass
+    template<class It>
+    auto borrow_all(It first, It last) {
+        using Traits = dep_traits_of<It>;
+        std::vector<borrow<typename Traits::pointer>> borrows;
+        borrows.reserve(static_cast<size_t>(std::distance(first, last)));
+        for (size_t index = 0; first != last; ++first, ++index) {
+            const bool owned = first->has_owner();
+            Traits::error_handler::check_condition(owned, "owner has been deleted");
+            if (owned) {
+                borrows.push_back({index, static_cast<typename Traits::pointer>(*first)});
+            }
+        }
+        return borrows;
+    }
+
+    /// Reports owners of borrowed targets that were destroyed while the workers were running
+    template<class It, class Borrows>
+    void check_still_owned(It first, const Borrows &borrows) {
+        size_t index = 0;
+        for (const auto &b: borrows) {
+            std::advance(first, b.index - index);
+            index = b.index;
+            dep_traits_of<It>::error_handler::check_condition(first->has_owner(),
+                                                              "owner destroyed during parallel algorithm");
+        }
+    }
+
+    /// Calls chunk(worker, begin, end) for contiguous chunks of [0, count), one per worker, on
+    /// worker threads and the calling thread. Returns the number of workers. Rethrows the first
+    /// exception of a worker after all of them have finished. If a thread cannot be started, the
+    /// calling thread runs the chunks of the workers that were not started.
+    template<class Chunk>
+    unsigned run_in_chunks(size_t count, unsigned threads, Chunk &&chunk) {
+        if (!threads) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        const auto workers = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, count)));
+        const auto size = (count + workers - 1) / workers;
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        std::vector<std::exception_ptr> errors(workers);
+        auto run = [&](unsigned worker) {
+            try {
+                chunk(worker, std::min(count, worker * size), std::min(count, (worker + 1) * size));
+            } catch (...) {
+                errors[worker] = std::current_exception();
+            }
+        };
+#else
+        auto run = [&](unsigned worker) {
+            chunk(worker, std::min(count, worker * size), std::min(count, (worker + 1) * size));
+        };
+#endif
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        try {
+            for (unsigned worker = 1; worker < workers; ++worker) {
+                pool.emplace_back(run, worker);
+            }
+        } catch (const std::system_error &) {
+            // The threads that were started are joined below
+        }
+#else
+        for (unsigned worker = 1; worker < workers; ++worker) {
+            pool.emplace_back(run, worker);
+        }
+#endif
+        run(0);
+        for (auto worker = static_cast<unsigned>(pool.size()) + 1; worker < workers; ++worker) {
+            run(worker);
+        }
+        for (auto &thread: pool) {
+            thread.join();
+        }
+#ifdef OWNED_PTR_HAS_EXCEPTIONS
+        for (auto &error: errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+#endif
+        return workers;
+    }
+}
+
+/// Calls fn with a reference to the target of every dependency in [first, last), in parallel
+template<class It, class F>
+void parallel_for_each_dep(It first, It last, F fn, unsigned threads = 0) {
+    const auto borrows = owned_ptr_detail::borrow_all(first, last);
+    owned_ptr_detail::run_in_chunks(borrows.size(), threads, [&](unsigned, size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            fn(*borrows[i].target);
+        }
+    });
+    owned_ptr_detail::check_still_owned(first, borrows);
+}
+
+/// Writes fn(target) of the i'th dependency in [first, last) to out[i], in parallel.
+/// out must be a random access iterator. Elements for dependencies that fail the check are
+/// left untouched.
+template<class It, class OutIt, class F>
+OutIt parallel_transform_dep(It first, It last, OutIt out, F fn, unsigned threads = 0) {
+    const auto borrows = owned_ptr_detail::borrow_all(first, last);
+    owned_ptr_detail::run_in_chunks(borrows.size(), threads, [&](unsigned, size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            out[static_cast<typename std::iterator_traits<OutIt>::difference_type>(borrows[i].index)] =
+                    fn(*borrows[i].target);
+        }
+    });
+    owned_ptr_detail::check_still_owned(first, borrows);
+    return out + std::distance(first, last);
+}
+
+/// Returns init combined with transform(target) of every dependency in [first, last) by reduce,
+/// in parallel. reduce must be associative; the partial results of the workers are combined in
+/// range order.
+template<class It, class V, class Reduce, class Transform>
+V parallel_transform_reduce_dep(It first, It last, V init, Reduce reduce, Transform transform,
+                                unsigned threads = 0) {
+    const auto borrows = owned_ptr_detail::borrow_all(first, last);
+    std::vector<std::optional<V>> partials(threads ? threads : std::max(1u, std::thread::hardware_concurrency()));
+    owned_ptr_detail::run_in_chunks(borrows.size(), threads, [&](unsigned worker, size_t begin, size_t end) {
+        if (begin == end) {
+            return;
+        }
+        V partial = transform(*borrows[begin].target);
+        for (auto i = begin + 1; i < end; ++i) {
+            partial = reduce(std::move(partial), transform(*borrows[i].target));
+        }
+        partials[worker] = std::move(partial);
+    });
+    owned_ptr_detail::check_still_owned(first, borrows);
+    for (auto &partial: partials) {
+        if (partial) {
+            init = reduce(std::move(init), std::move(*partial));
+        }
+    }
+    return init;
+}
+
+#endif //OWNED_PTR_PARALLEL_DEPS_H
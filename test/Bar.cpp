@@ -9,3 +9,7 @@ Bar::Bar() : _foo{Foo{}} {
 }
 
 Bar::Bar(int value) : _value(value), _foo{Foo{}} {}
+
+dep_ptr<Foo> Bar::get_foo() {
+    return _foo.make_dep();
+}
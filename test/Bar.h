@@ -16,6 +16,8 @@ public:
 
     int get_value() const { return _value; }
 
+    dep_ptr<Foo> get_foo();
+
 private:
     int _value{};
     owned_ptr<Foo> _foo;
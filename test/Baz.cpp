@@ -0,0 +1,8 @@
+#include "Baz.h"
+#include "Foo.h"
+
+#include "owned_ptr.h"
+
+bool foo_is_alive(const dep_ptr<Foo> &foo) {
+    return foo.has_owner();
+}
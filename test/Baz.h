@@ -0,0 +1,11 @@
+#ifndef GTEST_DEMO_BAZ_H
+#define GTEST_DEMO_BAZ_H
+
+#include "owned_ptr_fwd.h"
+
+class Foo;
+
+// Only uses the forward declarations, the full header is included in the source file
+bool foo_is_alive(const dep_ptr<Foo> &foo);
+
+#endif //GTEST_DEMO_BAZ_H
@@ -0,0 +1,145 @@
+// Built with OWNED_PTR_TRACK_ALLOCATION_SITES defined
+
+#include "owned_ptr.h"
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+struct Record {
+    char bytes[100];
+};
+
+// Holds a dependency on itself, which its destructor releases
+struct SelfReference {
+    std::optional<dep_ptr<SelfReference>> self;
+};
+
+struct deferred_error_handler {
+    static void check_condition(bool condition, const char *reason) {
+        (void) reason;
+        (void) condition;
+    }
+
+    static constexpr bool reset_when_moved_from{true};
+
+    static constexpr bool defer_ref_counts{true};
+};
+
+// Not in an anonymous namespace, so that dladdr can find the names in the executable
+
+OWNED_PTR_NOINLINE vector<owned_ptr<Record>> load_records(size_t count) {
+    vector<owned_ptr<Record>> records;
+    for (size_t i = 0; i < count; ++i) {
+        records.push_back(make_owned<Record>());
+    }
+    return records;
+}
+
+OWNED_PTR_NOINLINE owned_ptr<Record> make_cache_entry() {
+    return make_owned<Record>();
+}
+
+OWNED_PTR_NOINLINE owned_ptr<SelfReference> make_self_reference() {
+    auto owner = make_owned<SelfReference>();
+    owner->self = owner.make_dep();
+    return owner;
+}
+
+OWNED_PTR_NOINLINE owned_ptr<Record, deferred_error_handler> make_deferred_entry() {
+    return owned_ptr<Record, deferred_error_handler>{};
+}
+
+namespace {
+    const owned_ptr_allocation_sites::site *find_site(const vector<owned_ptr_allocation_sites::site> &sites,
+                                                      const string &function) {
+        auto it = find_if(sites.begin(), sites.end(), [&](const owned_ptr_allocation_sites::site &s) {
+            return s.symbol.find(function) != string::npos;
+        });
+        return it == sites.end() ? nullptr : &*it;
+    }
+}
+
+TEST(AllocationSites, blocks_are_attributed_to_the_calling_function) {
+    auto records = load_records(10);
+    auto entry = make_cache_entry();
+    const auto sites = owned_ptr_allocation_sites::snapshot();
+    const auto *loader = find_site(sites, "load_records");
+    const auto *cache = find_site(sites, "make_cache_entry");
+    ASSERT_NE(loader, nullptr);
+    ASSERT_NE(cache, nullptr);
+    ASSERT_EQ(loader->live_blocks, 10u);
+    ASSERT_EQ(cache->live_blocks, 1u);
+    ASSERT_GE(loader->live_bytes, 10 * sizeof(Record));
+    ASSERT_EQ(loader->live_bytes, 10 * cache->live_bytes);
+    ASSERT_GT(loader->allocations_per_second, 0);
+    // The site with the most bytes comes first
+    ASSERT_EQ(loader, &sites.front());
+}
+
+TEST(AllocationSites, zombies_are_counted_until_the_last_dep_is_gone) {
+    auto entry = make_cache_entry();
+    auto dep = entry.make_dep();
+    entry = owned_ptr<Record>{};
+    auto sites = owned_ptr_allocation_sites::snapshot();
+    const auto *zombie = find_site(sites, "make_cache_entry");
+    ASSERT_NE(zombie, nullptr);
+    ASSERT_EQ(zombie->zombie_blocks, 1u);
+    ASSERT_EQ(zombie->live_blocks, 0u); // The replacement is attributed to this test
+    {
+        auto released = std::move(dep);
+    }
+    // Sites without blocks or recent allocations are left out
+    sites = owned_ptr_allocation_sites::snapshot();
+    ASSERT_EQ(find_site(sites, "make_cache_entry"), nullptr);
+}
+
+TEST(AllocationSites, released_blocks_leave_the_live_counts) {
+    {
+        auto records = load_records(5);
+        auto copy = records[0].clone();
+    }
+    owned_ptr_allocation_sites::snapshot();
+    const auto sites = owned_ptr_allocation_sites::snapshot();
+    ASSERT_EQ(find_site(sites, "load_records"), nullptr);
+}
+
+TEST(AllocationSites, dump_prints_a_table) {
+    auto records = load_records(3);
+    char buffer[4096]{};
+    FILE *out = fmemopen(buffer, sizeof(buffer), "w");
+    owned_ptr_allocation_sites::dump(out);
+    fclose(out);
+    const string text{buffer};
+    ASSERT_NE(text.find("live bytes"), string::npos);
+    ASSERT_NE(text.find("load_records"), string::npos);
+}
+
+TEST(AllocationSites, dependency_released_by_the_destructor_leaves_no_zombie) {
+    {
+        auto owner = make_self_reference();
+        ASSERT_EQ(owner.num_deps(), 1u);
+    }
+    owned_ptr_allocation_sites::snapshot();
+    const auto sites = owned_ptr_allocation_sites::snapshot();
+    ASSERT_EQ(find_site(sites, "make_self_reference"), nullptr);
+}
+
+TEST(AllocationSites, zombies_with_deferred_counts_are_freed_at_safepoint) {
+    auto entry = make_deferred_entry();
+    optional<dep_ptr<Record, deferred_error_handler>> dep{entry.make_dep()};
+    entry = owned_ptr<Record, deferred_error_handler>{};
+    auto sites = owned_ptr_allocation_sites::snapshot();
+    const auto *zombie = find_site(sites, "make_deferred_entry");
+    ASSERT_NE(zombie, nullptr);
+    ASSERT_EQ(zombie->zombie_blocks, 1u);
+    dep.reset();
+    owned_ptr_safepoint();
+    sites = owned_ptr_allocation_sites::snapshot();
+    ASSERT_EQ(find_site(sites, "make_deferred_entry"), nullptr);
+}
@@ -0,0 +1,156 @@
+#include "atomic_owned_slot.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Table {
+        explicit Table(int version) : version{version} {}
+
+        ~Table() {
+            alive = false;
+            destroyed++;
+        }
+
+        int version;
+        std::atomic<bool> alive{true};
+        static std::atomic<int> destroyed;
+    };
+
+    std::atomic<int> Table::destroyed{0};
+
+    struct recording_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static int failures;
+    };
+
+    int recording_error_handler::failures{0};
+
+    struct AtomicOwnedSlot : public testing::Test {
+        AtomicOwnedSlot() {
+            Table::destroyed = 0;
+        }
+    };
+}
+
+TEST_F(AtomicOwnedSlot, read_returns_current_object) {
+    atomic_owned_slot<string> slot{make_owned<string>("first")};
+    atomic_owned_slot<string>::reader reader{slot};
+    ASSERT_EQ(*reader.read(), "first");
+    slot.store(make_owned<string>("second"));
+    ASSERT_EQ(*reader.read(), "second");
+    ASSERT_EQ(reader.read()->size(), 6u);
+}
+
+TEST_F(AtomicOwnedSlot, store_destroys_old_object) {
+    atomic_owned_slot<Table> slot{make_owned<Table>(1)};
+    ASSERT_EQ(Table::destroyed, 0);
+    slot.store(make_owned<Table>(2));
+    ASSERT_EQ(Table::destroyed, 1);
+}
+
+TEST_F(AtomicOwnedSlot, dep_to_old_version_has_no_owner_after_store) {
+    atomic_owned_slot<Table> slot{make_owned<Table>(1)};
+    auto old_dep = slot.make_dep();
+    ASSERT_TRUE(old_dep.has_owner());
+    ASSERT_EQ(old_dep->version, 1);
+    slot.store(make_owned<Table>(2));
+    ASSERT_FALSE(old_dep.has_owner());
+    auto new_dep = slot.make_dep();
+    ASSERT_TRUE(new_dep.has_owner());
+    ASSERT_EQ(new_dep->version, 2);
+}
+
+TEST_F(AtomicOwnedSlot, nested_reads_share_pin) {
+    atomic_owned_slot<Table> slot{make_owned<Table>(1)};
+    atomic_owned_slot<Table>::reader reader{slot};
+    auto outer = reader.read();
+    {
+        auto inner = reader.read();
+        ASSERT_EQ(inner->version, 1);
+    }
+    ASSERT_EQ(outer->version, 1);
+}
+
+TEST_F(AtomicOwnedSlot, old_object_outlives_pinned_reader) {
+    atomic_owned_slot<Table> slot{make_owned<Table>(1)};
+    std::atomic<bool> stored{false};
+    std::thread writer;
+    {
+        atomic_owned_slot<Table>::reader reader{slot};
+        auto view = reader.read();
+        writer = std::thread{[&] {
+            slot.store(make_owned<Table>(2));
+            stored = true;
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ASSERT_FALSE(stored);
+        ASSERT_TRUE(view->alive);
+        ASSERT_EQ(view->version, 1);
+    }
+    writer.join();
+    ASSERT_TRUE(stored);
+    ASSERT_EQ(Table::destroyed, 1);
+}
+
+TEST_F(AtomicOwnedSlot, concurrent_readers_never_see_destroyed_object) {
+    atomic_owned_slot<Table> slot{make_owned<Table>(0)};
+    std::atomic<bool> done{false};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            atomic_owned_slot<Table>::reader reader{slot};
+            int last_version = 0;
+            while (!done) {
+                auto view = reader.read();
+                if (!view->alive || view->version < last_version) {
+                    failures++;
+                }
+                last_version = view->version;
+            }
+        });
+    }
+    for (int version = 1; version <= 200; ++version) {
+        slot.store(make_owned<Table>(version));
+    }
+    done = true;
+    for (auto &t: readers) {
+        t.join();
+    }
+    ASSERT_EQ(failures, 0);
+    ASSERT_EQ(Table::destroyed, 200);
+}
+
+TEST_F(AtomicOwnedSlot, store_while_reading_on_same_thread_is_reported) {
+    using checked_slot = atomic_owned_slot<Table, recording_error_handler>;
+    recording_error_handler::failures = 0;
+    checked_slot slot{owned_ptr<Table, recording_error_handler>(1)};
+    checked_slot::reader reader{slot};
+    {
+        auto view = reader.read();
+        slot.store(owned_ptr<Table, recording_error_handler>(2));
+        ASSERT_EQ(recording_error_handler::failures, 1);
+        ASSERT_EQ(view->version, 1);
+        ASSERT_EQ(Table::destroyed, 1); // The replacement that was not stored
+    }
+    ASSERT_EQ(reader.read()->version, 1);
+    slot.store(owned_ptr<Table, recording_error_handler>(3));
+    ASSERT_EQ(reader.read()->version, 3);
+    ASSERT_EQ(recording_error_handler::failures, 1);
+}
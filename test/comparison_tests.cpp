@@ -0,0 +1,112 @@
+#include "owned_ptr.h"
+
+#include <exception>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    class FailureDetected : public runtime_error {
+    public:
+        explicit FailureDetected(const string& message) : runtime_error(message) {}
+    };
+
+    struct throwing_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            if (!condition) {
+                throw FailureDetected(reason);
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+    };
+
+    using ptr = owned_ptr<string, throwing_error_handler>;
+    using dep = dep_ptr<string, throwing_error_handler>;
+}
+
+TEST(Comparison, handles_to_same_object_are_equal) {
+    auto foo = ptr("foo");
+    auto bar = ptr("foo");
+    const auto &const_foo = foo;
+    auto dep1 = foo.make_dep();
+    auto dep2 = foo.make_dep();
+    auto dep_const = const_foo.make_dep();
+    auto dep_bar = bar.make_dep();
+    ASSERT_TRUE(dep1 == dep2);
+    ASSERT_TRUE(foo == dep1);
+    ASSERT_TRUE(dep1 == foo);
+    ASSERT_TRUE(dep_const == dep1);
+    ASSERT_TRUE(dep1 != dep_bar);
+    ASSERT_TRUE(foo != bar);
+    ASSERT_TRUE(dep1 == static_cast<const string *>(foo));
+    ASSERT_TRUE(static_cast<string *>(foo) == dep_const);
+}
+
+TEST(Comparison, ordering_is_consistent) {
+    auto foo = ptr("foo");
+    auto bar = ptr("bar");
+    auto dep_foo = foo.make_dep();
+    auto dep_bar = bar.make_dep();
+    ASSERT_NE(dep_foo < dep_bar, dep_bar < dep_foo);
+    ASSERT_EQ(dep_foo < dep_bar, foo < bar);
+    ASSERT_EQ(dep_foo > dep_bar, dep_bar < dep_foo);
+    ASSERT_TRUE(dep_foo <= foo);
+    ASSERT_TRUE(dep_foo >= foo);
+}
+
+TEST(Comparison, comparing_and_hashing_never_reports_errors) {
+    auto foo = make_unique<ptr>("foo");
+    auto moved_from = ptr("bar");
+    auto moved_to{std::move(moved_from)};
+    auto dep1 = foo->make_dep();
+    auto dep2 = foo->make_dep();
+    foo = nullptr;
+    ASSERT_TRUE(dep1 == dep2);
+    ASSERT_TRUE(moved_from == nullptr); // NOLINT
+    ASSERT_TRUE(moved_to != nullptr);
+    ASSERT_TRUE(dep1 != nullptr);
+    ASSERT_EQ(std::hash<dep>{}(dep1), std::hash<dep>{}(dep2));
+    ASSERT_NO_THROW(std::hash<ptr>{}(moved_from)); // NOLINT
+}
+
+TEST(Comparison, handles_as_unordered_keys) {
+    auto foo = ptr("foo");
+    auto bar = ptr("bar");
+    unordered_map<dep, int> registry;
+    registry[foo.make_dep()] = 1;
+    registry[bar.make_dep()] = 2;
+    registry[foo.make_dep()] = 3;
+    ASSERT_EQ(2u, registry.size());
+    ASSERT_EQ(3, registry[foo.make_dep()]);
+
+    unordered_set<ptr> owners;
+    owners.insert(std::move(foo));
+    ASSERT_EQ(1u, owners.size());
+}
+
+TEST(Comparison, heterogeneous_lookup_by_raw_pointer) {
+    auto foo = ptr("foo");
+    auto bar = ptr("bar");
+    const string *raw_bar = bar;
+    map<dep, int, owned_ptr_less> registry;
+    registry.emplace(foo.make_dep(), 1);
+    registry.emplace(bar.make_dep(), 2);
+    auto found = registry.find(raw_bar);
+    ASSERT_NE(found, registry.end());
+    ASSERT_EQ(2, found->second);
+
+    set<dep, owned_ptr_less> deps;
+    deps.insert(foo.make_dep());
+    ASSERT_EQ(1u, deps.count(static_cast<const string *>(foo)));
+    ASSERT_EQ(0u, deps.count(raw_bar));
+    ASSERT_EQ(owned_ptr_hash{}(raw_bar), owned_ptr_hash{}(bar));
+    ASSERT_TRUE(owned_ptr_equal{}(raw_bar, bar.make_dep()));
+}
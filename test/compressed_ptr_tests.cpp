@@ -0,0 +1,120 @@
+#include "compressed_ptr.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Node {
+        explicit Node(int value) : value{value} {}
+
+        int value;
+        compressed_owned_ptr<Node> left;
+        compressed_owned_ptr<Node> right;
+    };
+
+    struct Throwing {
+        explicit Throwing(bool fail) {
+            if (fail) {
+                throw runtime_error{"construction failed"};
+            }
+        }
+    };
+
+    struct Edge {
+        explicit Edge(compressed_owned_ptr<Node> &target) : target{target.make_dep()} {}
+
+        compressed_dep_ptr<Node> target;
+    };
+
+    struct CompressedHeap : public testing::Test {
+        CompressedHeap() {
+            compressed_heap::attach(region);
+        }
+
+        ~CompressedHeap() override {
+            compressed_heap::detach();
+        }
+
+        owned_region region{owned_region::reserve(1 << 20)};
+    };
+}
+
+TEST(CompressedPtr, handles_are_half_the_size) {
+    static_assert(sizeof(compressed_owned_ptr<Node>) == 4, "");
+    static_assert(sizeof(compressed_dep_ptr<Node>) == 4, "");
+    static_assert(sizeof(Node) == sizeof(int) + 2 * sizeof(std::uint32_t), "");
+    ASSERT_EQ(sizeof(compressed_dep_ptr<Node>) * 2, sizeof(dep_ptr<Node>));
+}
+
+TEST_F(CompressedHeap, tree_is_built_and_read_through_indices) {
+    auto root = compressed_heap::make_owned<Node>(1);
+    root->left = compressed_heap::make_owned<Node>(2);
+    root->right = compressed_heap::make_owned<Node>(3);
+    root->left->right = compressed_heap::make_owned<Node>(4);
+    ASSERT_EQ(root->value, 1);
+    ASSERT_EQ(root->left->value, 2);
+    ASSERT_EQ(root->right->value, 3);
+    ASSERT_EQ(root->left->right->value, 4);
+    ASSERT_EQ(root->right->left, nullptr);
+}
+
+TEST_F(CompressedHeap, dependency_detects_deleted_owner) {
+    auto node = compressed_heap::make_owned<Node>(5);
+    auto edge = compressed_heap::make_owned<Edge>(node);
+    ASSERT_EQ(node.num_deps(), 1u);
+    ASSERT_EQ(edge->target->value, 5);
+    auto copy = edge->target;
+    ASSERT_EQ(node.num_deps(), 2u);
+    node = compressed_owned_ptr<Node>{};
+    ASSERT_FALSE(edge->target.has_owner());
+    ASSERT_FALSE(copy.has_owner());
+}
+
+TEST_F(CompressedHeap, moved_from_dep_is_empty) {
+    auto node = compressed_heap::make_owned<Node>(5);
+    auto dep = node.make_dep();
+    auto moved = std::move(dep);
+    ASSERT_FALSE(dep.has_owner()); // NOLINT(bugprone-use-after-move)
+    ASSERT_TRUE(moved.has_owner());
+    ASSERT_EQ(node.num_deps(), 1u);
+}
+
+TEST_F(CompressedHeap, zombie_block_is_kept_until_last_dep) {
+    auto node = compressed_heap::make_owned<Node>(1);
+    {
+        auto dep = node.make_dep();
+        node = compressed_owned_ptr<Node>{};
+        const auto used = region.used();
+        auto other = compressed_heap::make_owned<Node>(2);
+        ASSERT_GT(region.used(), used);
+    }
+    const auto used = region.used();
+    auto reused = compressed_heap::make_owned<Node>(3);
+    ASSERT_EQ(region.used(), used);
+}
+
+TEST_F(CompressedHeap, full_heap_returns_empty_handle) {
+    vector<compressed_owned_ptr<Node>> nodes;
+    for (;;) {
+        auto node = compressed_heap::make_owned<Node>(0);
+        if (node == nullptr) {
+            break;
+        }
+        nodes.push_back(std::move(node));
+    }
+    ASSERT_FALSE(nodes.empty());
+    nodes.pop_back();
+    ASSERT_NE(compressed_heap::make_owned<Node>(0), nullptr);
+}
+
+TEST_F(CompressedHeap, block_is_returned_when_constructor_throws) {
+    ASSERT_THROW(compressed_heap::make_owned<Throwing>(true), runtime_error);
+    const auto used = region.used();
+    auto object = compressed_heap::make_owned<Throwing>(false);
+    ASSERT_NE(object, nullptr);
+    ASSERT_EQ(region.used(), used);
+}
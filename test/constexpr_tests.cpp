@@ -0,0 +1,70 @@
+#include "owned_ptr.h"
+
+#include <array>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Node {
+        int value;
+    };
+
+    constexpr int sum_of_deps() {
+        auto a = make_owned<Node>(Node{1});
+        auto b = make_owned<Node>(Node{2});
+        auto dep_a = a.make_dep();
+        const auto &const_b = b;
+        auto dep_b = const_b.make_dep();
+        auto copy = dep_a;
+        return dep_a->value + copy->value + dep_b->value + static_cast<int>(a.num_deps());
+    }
+
+    constexpr bool dep_detects_deleted_owner() {
+        auto owner = make_owned<int>(1);
+        auto dep = owner.make_dep();
+        const auto before = dep.has_owner();
+        {
+            auto gone = std::move(owner);
+        }
+        return before && !dep.has_owner();
+    }
+
+    constexpr bool moved_dep_is_reset() {
+        auto owner = make_owned<int>(1);
+        auto dep = owner.make_dep();
+        auto moved = std::move(dep);
+        return !dep.has_owner() && moved.has_owner() && owner.num_deps() == 1;
+    }
+
+    /// Builds a chain of owned nodes and flattens it into a table, all at compile time
+    template<size_t N>
+    constexpr array<int, N> squares_table() {
+        array<int, N> table{};
+        owned_ptr<Node> nodes[N];
+        for (size_t i = 0; i < N; ++i) {
+            nodes[i] = make_owned<Node>(Node{static_cast<int>(i * i)});
+        }
+        for (size_t i = 0; i < N; ++i) {
+            auto dep = nodes[i].make_dep();
+            table[i] = dep->value;
+        }
+        return table;
+    }
+}
+
+static_assert(sum_of_deps() == 6);
+static_assert(dep_detects_deleted_owner());
+static_assert(moved_dep_is_reset());
+
+constexpr auto squares = squares_table<8>();
+static_assert(squares[7] == 49);
+
+TEST(Constexpr, same_code_runs_at_runtime) {
+    ASSERT_EQ(sum_of_deps(), 6);
+    ASSERT_TRUE(dep_detects_deleted_owner());
+    ASSERT_TRUE(moved_dep_is_reset());
+    ASSERT_EQ(squares_table<8>()[3], 9);
+}
@@ -0,0 +1,57 @@
+#include "owned_ptr.h"
+
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Throwing {
+        explicit Throwing(bool fail) {
+            if (fail) {
+                throw runtime_error{"construction failed"};
+            }
+        }
+    };
+
+    // Too large to ever be allocated
+    struct Huge {
+        char data[size_t{1} << 60u];
+    };
+}
+
+#ifdef OWNED_PTR_HAS_ASAN
+// AddressSanitizer aborts on allocations of this size unless told to return nullptr like malloc
+extern "C" const char *__asan_default_options() {
+    return "allocator_may_return_null=1";
+}
+#endif
+
+TEST(Construction, throwing_constructor_is_passed_on) {
+    ASSERT_THROW(make_owned<Throwing>(true), runtime_error);
+    auto owned = make_owned<Throwing>(false);
+    ASSERT_NE(owned, nullptr);
+}
+
+TEST(Construction, failed_allocation_throws_bad_alloc) {
+    ASSERT_THROW(make_owned<Huge>(), bad_alloc);
+}
+
+TEST(Construction, try_make_owned_creates_object) {
+    auto owned = try_make_owned<string>("text");
+    ASSERT_NE(owned, nullptr);
+    ASSERT_EQ(*owned, "text");
+    auto dep = owned.make_dep();
+    ASSERT_TRUE(dep.has_owner());
+}
+
+TEST(Construction, try_make_owned_returns_empty_handle_on_allocation_failure) {
+    auto owned = try_make_owned<Huge>();
+    ASSERT_EQ(owned, nullptr);
+}
+
+TEST(Construction, try_make_owned_passes_on_constructor_exceptions) {
+    ASSERT_THROW((void) try_make_owned<Throwing>(true), runtime_error);
+}
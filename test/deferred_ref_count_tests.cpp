@@ -0,0 +1,166 @@
+#include "owned_ptr.h"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct deferred_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static constexpr bool defer_ref_counts{true};
+
+        static int failures;
+    };
+
+    int deferred_error_handler::failures{0};
+
+    struct Counted {
+        Counted() { alive++; }
+
+        ~Counted() { alive--; }
+
+        int value{5};
+
+        static int alive;
+    };
+
+    int Counted::alive{0};
+
+    using deferred_owner = owned_ptr<Counted, deferred_error_handler>;
+
+    struct DeferredRefCounts : public testing::Test {
+        DeferredRefCounts() {
+            owned_ptr_safepoint();
+            deferred_error_handler::failures = 0;
+            Counted::alive = 0;
+        }
+    };
+}
+
+TEST_F(DeferredRefCounts, num_deps_is_exact) {
+    deferred_owner owner{};
+    auto dep = owner.make_dep();
+    auto copy = dep;
+    ASSERT_EQ(owner.num_deps(), 2u);
+    {
+        auto another = copy;
+        ASSERT_EQ(owner.num_deps(), 3u);
+    }
+    ASSERT_EQ(owner.num_deps(), 2u);
+    ASSERT_EQ(copy->value, 5);
+}
+
+TEST_F(DeferredRefCounts, copies_and_destruction_cancel_out) {
+    deferred_owner owner{};
+    auto dep = owner.make_dep();
+    for (int i = 0; i < 1000; ++i) {
+        auto copy = dep;
+        ASSERT_EQ(copy->value, 5);
+    }
+    ASSERT_EQ(owner.num_deps(), 1u);
+}
+
+TEST_F(DeferredRefCounts, owner_checks_are_exact) {
+    auto owner = std::make_unique<deferred_owner>();
+    auto dep = owner->make_dep();
+    owner.reset();
+    ASSERT_EQ(Counted::alive, 0);
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_EQ(deferred_error_handler::failures, 0);
+}
+
+TEST_F(DeferredRefCounts, zombie_is_freed_at_safepoint) {
+    auto owner = std::make_unique<deferred_owner>();
+    std::optional<dep_ptr<Counted, deferred_error_handler>> dep{owner->make_dep()};
+    std::optional<dep_ptr<Counted, deferred_error_handler>> sibling{*dep};
+    ASSERT_EQ(owner->num_deps(), 2u);
+    // The reference count of the zombie is read from its control block, which is valid until the
+    // block is freed
+    const Counted *object = *owner;
+    auto *storage = const_cast<char *>(reinterpret_cast<const char *>(object)) - sizeof(owned_ptr_core::control);
+    owner.reset();
+    ASSERT_EQ(Counted::alive, 0);
+
+    dep.reset();
+    ASSERT_EQ(owned_ptr_core::num_deps(storage), 2u);
+    owned_ptr_safepoint();
+    ASSERT_EQ(owned_ptr_core::num_deps(storage), 1u);
+
+    // Releasing the last dependency leaves the block for the safepoint to free
+    sibling.reset();
+    ASSERT_EQ(owned_ptr_core::num_deps(storage), 1u);
+    // LeakSanitizer reports the block at exit if it is not freed here (see test/CMakeLists.txt)
+    owned_ptr_safepoint();
+    ASSERT_EQ(deferred_error_handler::failures, 0);
+}
+
+TEST_F(DeferredRefCounts, changes_to_many_blocks_are_applied_when_the_table_fills) {
+    std::vector<deferred_owner> owners(500);
+    std::vector<dep_ptr<Counted, deferred_error_handler>> deps;
+    for (auto &owner: owners) {
+        deps.push_back(owner.make_dep());
+    }
+    for (auto &owner: owners) {
+        ASSERT_EQ(owner.num_deps(), 1u);
+    }
+    deps.clear();
+    for (auto &owner: owners) {
+        ASSERT_EQ(owner.num_deps(), 0u);
+    }
+}
+
+TEST_F(DeferredRefCounts, owner_destruction_only_applies_its_own_changes) {
+    deferred_owner first{};
+    deferred_owner second{};
+    auto first_dep = first.make_dep();
+    {
+        auto second_dep = second.make_dep();
+        auto owner = std::make_unique<deferred_owner>();
+        owner->make_dep();
+        owner.reset();
+        ASSERT_EQ(second.num_deps(), 1u);
+    }
+    ASSERT_EQ(first.num_deps(), 1u);
+    ASSERT_EQ(second.num_deps(), 0u);
+}
+
+namespace {
+    struct thread_exit_holder {
+        std::optional<dep_ptr<Counted, deferred_error_handler>> dep;
+    };
+}
+
+TEST_F(DeferredRefCounts, dependencies_in_thread_locals_are_released_at_thread_exit) {
+    deferred_owner owner{};
+    auto dep = owner.make_dep();
+    owned_ptr_safepoint();
+    std::thread{[&dep]() {
+        // Constructed before the table of the thread, so destroyed after it
+        static thread_local thread_exit_holder holder;
+        holder.dep = dep;
+        auto copy = dep;
+    }}.join();
+    ASSERT_EQ(owner.num_deps(), 1u);
+}
+
+TEST_F(DeferredRefCounts, changes_are_applied_at_thread_exit) {
+    deferred_owner owner{};
+    auto dep = owner.make_dep();
+    auto copy = dep;
+    owned_ptr_safepoint();
+    std::thread{[copy = std::move(copy)]() mutable {
+        auto another = copy;
+        ASSERT_EQ(another->value, 5);
+    }}.join();
+    ASSERT_EQ(owner.num_deps(), 1u);
+}
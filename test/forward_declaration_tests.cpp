@@ -0,0 +1,18 @@
+// Kept apart from owned_ptr_test.cpp, which must not include Foo.h: there Foo is incomplete
+// where Bar is destroyed
+#include "Baz.h"
+#include "Foo.h"
+
+#include "owned_ptr.h"
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+TEST(ForwardDeclarations, forward_declared_handles) {
+    auto foo = std::make_unique<owned_ptr<Foo>>();
+    auto dep = foo->make_dep();
+    ASSERT_TRUE(foo_is_alive(dep));
+    foo = nullptr;
+    ASSERT_FALSE(foo_is_alive(dep));
+}
@@ -0,0 +1,87 @@
+#include "generational_ptr.h"
+
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Widget {
+        explicit Widget(string name) : name{std::move(name)} {}
+
+        string name;
+    };
+
+    struct Gadget {
+        int value;
+    };
+}
+
+TEST(GenerationalPtr, dependencies_are_trivially_copyable) {
+    static_assert(is_trivially_copyable_v<generational_dep_ptr<Widget>>, "");
+    static_assert(sizeof(generational_dep_ptr<Widget>) == 2 * sizeof(dep_ptr<Widget>), "");
+}
+
+TEST(GenerationalPtr, dependency_reads_object_while_owner_exists) {
+    auto owner = make_generational<Widget>("first");
+    auto dep = owner.make_dep();
+    auto copy = dep;
+    ASSERT_TRUE(copy.has_owner());
+    ASSERT_EQ(copy->name, "first");
+    ASSERT_EQ(static_cast<Widget *>(dep), static_cast<Widget *>(owner));
+}
+
+TEST(GenerationalPtr, releasing_owner_invalidates_every_copy) {
+    auto owner = make_generational<Widget>("first");
+    auto dep = owner.make_dep();
+    auto copy = dep;
+    {
+        auto moved = std::move(owner);
+    }
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_FALSE(copy.has_owner());
+}
+
+TEST(GenerationalPtr, block_is_reused_at_once_and_stale_dependency_notices) {
+    auto owner = make_generational<Gadget>(1);
+    auto stale = owner.make_dep();
+    auto *address = static_cast<Gadget *>(owner);
+    owner = make_generational<Gadget>(2);
+    // The old block was released when the first object was, and is reused by the next one
+    auto next = make_generational<Gadget>(3);
+    ASSERT_EQ(static_cast<Gadget *>(next), address);
+    ASSERT_FALSE(stale.has_owner());
+    ASSERT_TRUE(next.make_dep().has_owner());
+    ASSERT_EQ(next.make_dep()->value, 3);
+}
+
+TEST(GenerationalPtr, moved_from_owner_keeps_dependencies_valid) {
+    auto owner = make_generational<Gadget>(7);
+    auto dep = owner.make_dep();
+    auto moved = std::move(owner);
+    ASSERT_TRUE(dep.has_owner());
+    ASSERT_EQ(dep->value, 7);
+}
+
+TEST(GenerationalPtr, threads_can_create_and_release_objects_of_the_same_type) {
+    auto churn = [](int first) {
+        vector<generational_owned_ptr<Gadget>> owners;
+        for (int round = 0; round < 100; ++round) {
+            for (int i = 0; i < 20; ++i) {
+                owners.push_back(make_generational<Gadget>(first + i));
+            }
+            for (int i = 0; i < 20; ++i) {
+                ASSERT_EQ(owners[static_cast<size_t>(i)].make_dep()->value, first + i);
+            }
+            owners.clear();
+        }
+    };
+    thread a{churn, 0};
+    thread b{churn, 1000};
+    a.join();
+    b.join();
+}
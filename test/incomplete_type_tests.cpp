@@ -0,0 +1,24 @@
+// Only includes the header of the owner, so that Foo is an incomplete type here, which is how
+// owned_ptr members are used in classes that follow the rule of zero
+#include "Bar.h"
+
+#include <memory>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+TEST(IncompleteTypes, destroy_owner_of_incomplete_type) {
+    Bar bar{42};
+    ASSERT_EQ(bar.get_value(), 42);
+}
+
+TEST(IncompleteTypes, copy_and_destroy_deps_of_incomplete_type) {
+    auto bar = std::make_unique<Bar>(42);
+    auto dep = bar->get_foo();
+    auto copy = dep;
+    const dep_ptr<Foo> moved{std::move(copy)};
+    ASSERT_TRUE(moved.has_owner());
+    bar.reset();
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_FALSE(moved.has_owner());
+}
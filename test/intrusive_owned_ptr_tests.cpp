@@ -0,0 +1,116 @@
+#include "intrusive_owned_ptr.h"
+
+#include <array>
+#include <new>
+
+#include <gtest/gtest.h>
+
+namespace {
+    struct Connection;
+
+    /// A third party style pool with a fixed number of slots
+    struct ConnectionPool {
+        Connection *acquire(int id);
+
+        void give_back(Connection *connection);
+
+        alignas(8) std::array<unsigned char, 4 * 32> slots{};
+        std::array<bool, 4> used{};
+        int released{};
+    };
+
+    ConnectionPool pool;
+
+    struct Connection : owned_control_hook {
+        explicit Connection(int id) : owned_control_hook{[](owned_control_hook *hook) {
+            pool.give_back(static_cast<Connection *>(hook));
+        }}, id{id} {}
+
+        int id;
+    };
+
+    static_assert(sizeof(Connection) <= 32, "");
+
+    Connection *ConnectionPool::acquire(int id) {
+        for (size_t i = 0; i < used.size(); ++i) {
+            if (!used[i]) {
+                used[i] = true;
+                return new(&slots[i * 32]) Connection{id};
+            }
+        }
+        return nullptr;
+    }
+
+    void ConnectionPool::give_back(Connection *connection) {
+        const auto slot = static_cast<size_t>(reinterpret_cast<unsigned char *>(connection) - slots.data()) / 32;
+        connection->~Connection();
+        used[slot] = false;
+        ++released;
+    }
+
+    /// An object that lives inside a larger structure, and is never returned anywhere
+    struct Session : owned_control_hook {
+        Session() : owned_control_hook{[](owned_control_hook *hook) {
+            static_cast<Session *>(hook)->closed = true;
+        }} {}
+
+        bool closed{};
+    };
+
+    struct Server {
+        int port{80};
+        Session session;
+    };
+
+    struct IntrusiveOwnedPtr : public testing::Test {
+        IntrusiveOwnedPtr() {
+            pool.released = 0;
+        }
+    };
+}
+
+TEST_F(IntrusiveOwnedPtr, handles_are_one_pointer) {
+    static_assert(sizeof(intrusive_owned_ptr<Connection>) == sizeof(void *), "");
+    static_assert(sizeof(intrusive_dep_ptr<Connection>) == sizeof(void *), "");
+}
+
+TEST_F(IntrusiveOwnedPtr, object_returns_to_pool_when_owner_is_released) {
+    {
+        intrusive_owned_ptr<Connection> owner{pool.acquire(1)};
+        ASSERT_EQ(owner->id, 1);
+        ASSERT_EQ(pool.released, 0);
+    }
+    ASSERT_EQ(pool.released, 1);
+    ASSERT_FALSE(pool.used[0]);
+}
+
+TEST_F(IntrusiveOwnedPtr, dependency_keeps_object_out_of_pool_and_detects_owner_release) {
+    intrusive_owned_ptr<Connection> owner{pool.acquire(2)};
+    auto dep = owner.make_dep();
+    auto copy = dep;
+    ASSERT_EQ(owner.num_deps(), 2u);
+    ASSERT_EQ(copy->id, 2);
+    owner = intrusive_owned_ptr<Connection>{};
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_EQ(pool.released, 0);
+    {
+        auto moved = std::move(copy);
+    }
+    ASSERT_EQ(pool.released, 0);
+    {
+        auto last = std::move(dep);
+    }
+    ASSERT_EQ(pool.released, 1);
+}
+
+TEST_F(IntrusiveOwnedPtr, object_inside_larger_structure) {
+    Server server;
+    {
+        intrusive_owned_ptr<Session> owner{&server.session};
+        auto dep = owner.make_dep();
+        ASSERT_TRUE(dep.has_owner());
+        ASSERT_FALSE(server.session.closed);
+    }
+    ASSERT_TRUE(server.session.closed);
+    ASSERT_EQ(server.port, 80);
+}
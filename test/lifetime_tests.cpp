@@ -4,6 +4,8 @@
 
 #include "owned_ptr.h"
 
+#include <memory>
+
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -46,3 +48,14 @@ TEST_F(Lifetime, dep_destroyed_before_owner) {
     t = nullptr;
     ASSERT_TRUE(Target::destroyed);
 }
+
+struct SelfReferencing {
+    std::unique_ptr<dep_ptr<SelfReferencing>> self;
+};
+
+TEST_F(Lifetime, destructor_releases_last_dep) {
+    auto t = make_unique<owned_ptr<SelfReferencing>>();
+    (*t)->self = make_unique<dep_ptr<SelfReferencing>>(t->make_dep());
+    ASSERT_EQ(t->num_deps(), 1u);
+    t = nullptr;
+}
@@ -0,0 +1,37 @@
+// Built with exceptions disabled, to check the construction paths that do not depend on them
+#include "owned_ptr.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Huge {
+        char data[size_t{1} << 60u];
+    };
+}
+
+#ifdef OWNED_PTR_HAS_ASAN
+// AddressSanitizer aborts on allocations of this size unless told to return nullptr like malloc
+extern "C" const char *__asan_default_options() {
+    return "allocator_may_return_null=1";
+}
+#endif
+
+TEST(NoExceptions, make_owned_creates_object) {
+    auto owned = make_owned<string>("text");
+    ASSERT_EQ(*owned, "text");
+}
+
+TEST(NoExceptions, try_make_owned_creates_object) {
+    auto owned = try_make_owned<string>("text");
+    ASSERT_NE(owned, nullptr);
+    ASSERT_EQ(*owned, "text");
+}
+
+TEST(NoExceptions, try_make_owned_returns_empty_handle_on_allocation_failure) {
+    auto owned = try_make_owned<Huge>();
+    ASSERT_EQ(owned, nullptr);
+}
@@ -0,0 +1,105 @@
+#include "owned_buffer_pool.h"
+
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    using pool_type = owned_buffer_pool<>;
+
+    void fill(pool_type::buffer &buffer, const char *text) {
+        const auto length = strlen(text);
+        memcpy(buffer.data(), text, length);
+        buffer.resize(length);
+    }
+
+    string contents(const pool_type::dep &dep) {
+        return string{dep.data(), dep.size()};
+    }
+}
+
+TEST(OwnedBufferPool, acquire_returns_empty_buffer) {
+    pool_type pool{64};
+    auto buffer = pool.acquire();
+    ASSERT_EQ(buffer.size(), 0u);
+    ASSERT_EQ(buffer.capacity(), 64u);
+    ASSERT_EQ(pool.in_use(), 1u);
+    ASSERT_EQ(pool.available(), 0u);
+}
+
+TEST(OwnedBufferPool, preallocated_buffers_are_available) {
+    pool_type pool{64, 3};
+    ASSERT_EQ(pool.available(), 3u);
+    auto buffer = pool.acquire();
+    ASSERT_EQ(pool.available(), 2u);
+    ASSERT_EQ(pool.in_use(), 1u);
+}
+
+TEST(OwnedBufferPool, released_buffer_is_reused) {
+    pool_type pool{64};
+    const char *first_data;
+    {
+        auto buffer = pool.acquire();
+        first_data = buffer.data();
+    }
+    ASSERT_EQ(pool.available(), 1u);
+    auto buffer = pool.acquire();
+    ASSERT_EQ(buffer.data(), first_data);
+    ASSERT_EQ(buffer.size(), 0u);
+}
+
+TEST(OwnedBufferPool, deps_keep_buffer_out_of_pool) {
+    pool_type pool{64};
+    auto buffer = pool.acquire();
+    fill(buffer, "hello");
+    auto parser = buffer.make_dep();
+    auto writer = parser;
+    ASSERT_EQ(buffer.num_deps(), 2u);
+    buffer = pool.acquire();
+    ASSERT_EQ(pool.in_use(), 2u);
+    ASSERT_FALSE(parser.has_owner());
+    ASSERT_EQ(contents(parser), "hello");
+    {
+        auto done = std::move(parser);
+    }
+    ASSERT_EQ(pool.in_use(), 2u);
+    ASSERT_EQ(contents(writer), "hello");
+    writer = buffer.make_dep();
+    ASSERT_EQ(pool.in_use(), 1u);
+    ASSERT_EQ(pool.available(), 1u);
+}
+
+TEST(OwnedBufferPool, export_iovecs_gathers_non_empty_buffers) {
+    pool_type pool{64};
+    vector<pool_type::dep> in_flight;
+    for (const char *text: {"ab", "", "cde"}) {
+        auto buffer = pool.acquire();
+        fill(buffer, text);
+        in_flight.push_back(buffer.make_dep());
+    }
+    iovec vecs[4];
+    ASSERT_EQ(export_iovecs(in_flight.begin(), in_flight.end(), vecs, 4), 2u);
+    ASSERT_EQ(string(static_cast<const char *>(vecs[0].iov_base), vecs[0].iov_len), "ab");
+    ASSERT_EQ(string(static_cast<const char *>(vecs[1].iov_base), vecs[1].iov_len), "cde");
+    ASSERT_EQ(export_iovecs(in_flight.begin(), in_flight.end(), vecs, 1), 1u);
+}
+
+TEST(OwnedBufferPool, writable_iovec_covers_capacity) {
+    pool_type pool{32};
+    auto buffer = pool.acquire();
+    const auto vec = buffer.writable_iovec();
+    ASSERT_EQ(vec.iov_base, buffer.data());
+    ASSERT_EQ(vec.iov_len, 32u);
+}
+
+TEST(OwnedBufferPool, failed_allocation_throws_bad_alloc) {
+    pool_type pool{size_t{1} << 60u};
+    ASSERT_THROW((void) pool.acquire(), bad_alloc);
+    ASSERT_EQ(pool.in_use(), 0u);
+    ASSERT_THROW((pool_type{size_t{1} << 60u, 1}), bad_alloc);
+}
@@ -0,0 +1,148 @@
+#include "owned_lazy.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Expensive {
+        Expensive(string name, int size) : name{std::move(name)}, values(static_cast<size_t>(size)) {
+            constructed++;
+        }
+
+        ~Expensive() {
+            destroyed++;
+        }
+
+        string name;
+        vector<int> values;
+
+        static int constructed;
+        static int destroyed;
+    };
+
+    int Expensive::constructed{0};
+    int Expensive::destroyed{0};
+
+    /// Takes its argument by value, so it has been moved from when the constructor throws
+    struct Fragile {
+        explicit Fragile(vector<int> values) : values{std::move(values)} {
+            if (fail) {
+                throw runtime_error{"construction failed"};
+            }
+        }
+
+        vector<int> values;
+
+        static bool fail;
+    };
+
+    bool Fragile::fail{false};
+
+    struct recording_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static int failures;
+    };
+
+    int recording_error_handler::failures{0};
+
+    struct OwnedLazy : public testing::Test {
+        OwnedLazy() {
+            Expensive::constructed = 0;
+            Expensive::destroyed = 0;
+            recording_error_handler::failures = 0;
+            Fragile::fail = false;
+        }
+    };
+}
+
+TEST_F(OwnedLazy, object_is_constructed_on_first_access) {
+    auto lazy = make_lazy<Expensive>(string{"index"}, 100);
+    ASSERT_FALSE(lazy.is_constructed());
+    ASSERT_EQ(Expensive::constructed, 0);
+    ASSERT_EQ(lazy->name, "index");
+    ASSERT_EQ(lazy->values.size(), 100u);
+    ASSERT_TRUE(lazy.is_constructed());
+    ASSERT_EQ(Expensive::constructed, 1);
+}
+
+TEST_F(OwnedLazy, unused_object_is_never_constructed) {
+    {
+        auto lazy = make_lazy<Expensive>("unused", 1);
+        auto dep = lazy.make_dep();
+    }
+    ASSERT_EQ(Expensive::constructed, 0);
+    ASSERT_EQ(Expensive::destroyed, 0);
+}
+
+TEST_F(OwnedLazy, dependency_created_before_construction_constructs_on_access) {
+    auto lazy = make_lazy<Expensive>("shared", 3);
+    auto dep = lazy.make_dep();
+    ASSERT_EQ(lazy.num_deps(), 1u);
+    ASSERT_FALSE(lazy.is_constructed());
+    ASSERT_EQ(dep->values.size(), 3u);
+    ASSERT_TRUE(lazy.is_constructed());
+    ASSERT_EQ(static_cast<Expensive *>(dep), static_cast<Expensive *>(lazy));
+    ASSERT_EQ(Expensive::constructed, 1);
+}
+
+TEST_F(OwnedLazy, owner_deletes_object_and_dependency_detects_it) {
+    using lazy_type = owned_lazy<Expensive, recording_error_handler>;
+    auto lazy = lazy_type::create("gone", 1);
+    lazy.construct();
+    auto dep = lazy.make_dep();
+    lazy = lazy_type::create("other", 1);
+    ASSERT_EQ(Expensive::destroyed, 1);
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(OwnedLazy, arguments_are_moved_into_constructor) {
+    auto lazy = make_lazy<unique_ptr<int>>(make_unique<int>(42));
+    ASSERT_EQ(**lazy, 42);
+}
+
+TEST_F(OwnedLazy, call_once_variant_constructs_once_across_threads) {
+    auto lazy = owned_lazy<Expensive, owned_ptr_error_handler, lazy_call_once>::create("threads", 10);
+    vector<thread> threads;
+    vector<Expensive *> seen(8);
+    for (size_t i = 0; i < seen.size(); ++i) {
+        threads.emplace_back([&, i] { seen[i] = lazy; });
+    }
+    for (auto &t: threads) {
+        t.join();
+    }
+    ASSERT_EQ(Expensive::constructed, 1);
+    for (auto *object: seen) {
+        ASSERT_EQ(object, seen[0]);
+    }
+}
+
+TEST_F(OwnedLazy, failed_construction_is_reported_on_later_access) {
+    auto lazy = owned_lazy<Fragile, recording_error_handler>::create(vector<int>{1, 2, 3});
+    auto dep = lazy.make_dep();
+    Fragile::fail = true;
+    ASSERT_THROW(lazy.construct(), runtime_error);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+    // The arguments were moved into the failed attempt, so there is no retry
+    Fragile::fail = false;
+    ASSERT_EQ(static_cast<Fragile *>(dep), nullptr);
+    ASSERT_EQ(recording_error_handler::failures, 1);
+    ASSERT_FALSE(lazy.is_constructed());
+    ASSERT_EQ(static_cast<Fragile *>(lazy), nullptr);
+    ASSERT_EQ(recording_error_handler::failures, 2);
+}
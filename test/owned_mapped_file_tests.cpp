@@ -0,0 +1,119 @@
+#include "owned_mapped_file.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct recording_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static int failures;
+    };
+
+    int recording_error_handler::failures{0};
+
+    using mapped_file = owned_mapped_file<recording_error_handler>;
+
+    struct OwnedMappedFile : public testing::Test {
+        OwnedMappedFile() {
+            recording_error_handler::failures = 0;
+            vector<std::uint32_t> values(1024);
+            iota(values.begin(), values.end(), 0u);
+            FILE *file = fopen(path.c_str(), "wb");
+            fwrite(values.data(), sizeof(values[0]), values.size(), file);
+            fclose(file);
+        }
+
+        ~OwnedMappedFile() override {
+            remove(path.c_str());
+        }
+
+        string path{testing::TempDir() + "owned_mapped_file_test_" + to_string(getpid())};
+    };
+}
+
+TEST_F(OwnedMappedFile, typed_view_reads_file_contents) {
+    auto file = mapped_file::open(path.c_str());
+    ASSERT_TRUE(file.is_open());
+    ASSERT_EQ(file.size(), 4096u);
+    auto values = file.make_view<std::uint32_t>(0, 1024);
+    ASSERT_EQ(values.size(), 1024u);
+    ASSERT_EQ(values[0], 0u);
+    ASSERT_EQ(values[1023], 1023u);
+    ASSERT_EQ(accumulate(values.begin(), values.end(), 0ull), 1023ull * 1024 / 2);
+    ASSERT_EQ(file.num_deps(), 1u);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(OwnedMappedFile, subview_is_offset_in_bytes_into_its_parent) {
+    auto file = mapped_file::open(path.c_str(), mapped_file_access::sequential);
+    auto bytes = file.make_dep();
+    auto middle = bytes.subview<std::uint32_t>(400, 10);
+    ASSERT_EQ(middle[0], 100u);
+    auto tail = middle.subview(8, 2);
+    ASSERT_EQ(tail[1], 103u);
+    ASSERT_EQ(file.num_deps(), 3u);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(OwnedMappedFile, view_detects_released_owner_and_keeps_mapping) {
+    auto file = mapped_file::open(path.c_str());
+    auto values = file.make_view<std::uint32_t>(0, 1024);
+    ASSERT_TRUE(values.has_owner());
+    file = mapped_file{};
+    ASSERT_FALSE(values.has_owner());
+    ASSERT_EQ(recording_error_handler::failures, 0);
+    // The mapping is still there, so the failed check is all that happens
+    ASSERT_EQ(values[5], 5u);
+    ASSERT_EQ(recording_error_handler::failures, 1);
+}
+
+TEST_F(OwnedMappedFile, out_of_range_and_misaligned_views_are_reported) {
+    auto file = mapped_file::open(path.c_str());
+    auto too_long = file.make_view<std::uint32_t>(4, 1024);
+    ASSERT_EQ(recording_error_handler::failures, 1);
+    auto misaligned = file.make_view<std::uint32_t>(2, 1);
+    ASSERT_EQ(recording_error_handler::failures, 2);
+    auto bytes = file.make_view<char>(4096, 0);
+    ASSERT_TRUE(bytes.empty());
+    ASSERT_EQ(recording_error_handler::failures, 2);
+}
+
+TEST_F(OwnedMappedFile, moved_from_view_is_empty) {
+    auto file = mapped_file::open(path.c_str());
+    auto view = file.make_dep();
+    auto moved = std::move(view);
+    ASSERT_FALSE(view.has_owner()); // NOLINT(bugprone-use-after-move)
+    ASSERT_TRUE(moved.has_owner());
+    ASSERT_EQ(file.num_deps(), 1u);
+}
+
+TEST_F(OwnedMappedFile, advise_accepts_ranges) {
+    auto file = mapped_file::open(path.c_str());
+    ASSERT_TRUE(file.advise(mapped_file_access::will_need));
+    ASSERT_TRUE(file.advise(mapped_file_access::random, 100, 200));
+    ASSERT_FALSE(file.advise(mapped_file_access::normal, 5000));
+}
+
+TEST_F(OwnedMappedFile, missing_and_empty_files) {
+    ASSERT_FALSE(mapped_file::open((path + ".missing").c_str()).is_open());
+    fclose(fopen(path.c_str(), "wb"));
+    auto file = mapped_file::open(path.c_str());
+    ASSERT_TRUE(file.is_open());
+    ASSERT_EQ(file.size(), 0u);
+    ASSERT_TRUE(file.make_dep().empty());
+}
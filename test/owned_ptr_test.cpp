@@ -126,4 +126,4 @@ TEST(Basics, extreme_alignment) {
         int a;
     }__attribute__((aligned(256)));
     auto owned = make_owned<Foo>(1);
-}
\ No newline at end of file
+}
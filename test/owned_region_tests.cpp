@@ -0,0 +1,189 @@
+#include "owned_region.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Node {
+        explicit Node(int value) : value{value} {}
+
+        int value;
+        region_owned_ptr<Node> child;
+    };
+
+    struct Graph {
+        region_owned_ptr<Node> first;
+        region_owned_ptr<Node> second;
+    };
+
+    struct Throwing {
+        explicit Throwing(bool fail) {
+            if (fail) {
+                throw runtime_error{"construction failed"};
+            }
+        }
+    };
+
+    struct Link {
+        explicit Link(region_owned_ptr<Node> &target) : target{target.make_dep()} {}
+
+        region_dep_ptr<Node> target;
+    };
+
+    string temp_path() {
+        return testing::TempDir() + "owned_region_test_" + to_string(getpid());
+    }
+
+    struct OwnedRegion : public testing::Test {
+        ~OwnedRegion() override {
+            remove(path.c_str());
+        }
+
+        string path{temp_path()};
+    };
+
+    /// Builds a root node with a child
+    void build(owned_region &region) {
+        auto &root = region.root<Node>();
+        root = region.make_owned<Node>(1);
+        root->child = region.make_owned<Node>(2);
+    }
+}
+
+TEST_F(OwnedRegion, objects_survive_remapping) {
+    {
+        auto region = owned_region::create_file(path.c_str(), 1 << 16);
+        ASSERT_TRUE(region.is_open());
+        build(region);
+        ASSERT_TRUE(region.sync());
+    }
+    auto region = owned_region::open_file(path.c_str());
+    ASSERT_TRUE(region.is_open());
+    auto &root = region.root<Node>();
+    ASSERT_NE(root, nullptr);
+    ASSERT_EQ(root->value, 1);
+    ASSERT_EQ(root->child->value, 2);
+}
+
+TEST_F(OwnedRegion, two_mappings_at_different_addresses_see_the_same_graph) {
+    auto first = owned_region::create_file(path.c_str(), 1 << 16);
+    build(first);
+    auto dep = first.root<Node>()->child.make_dep();
+    auto second = owned_region::open_file(path.c_str());
+    auto &root = second.root<Node>();
+    ASSERT_NE(static_cast<Node *>(root), static_cast<Node *>(first.root<Node>()));
+    ASSERT_EQ(root->child->value, 2);
+    ASSERT_EQ(root->child.num_deps(), 1u);
+    root->child = region_owned_ptr<Node>{};
+    ASSERT_FALSE(dep.has_owner());
+}
+
+TEST_F(OwnedRegion, dependencies_stored_in_region_keep_their_semantics) {
+    auto region = owned_region::create_file(path.c_str(), 1 << 16);
+    auto target = region.make_owned<Node>(7);
+    auto link = region.make_owned<Link>(target);
+    ASSERT_EQ(target.num_deps(), 1u);
+    ASSERT_EQ(link->target->value, 7);
+    {
+        auto moved = std::move(target);
+    }
+    ASSERT_FALSE(link->target.has_owner());
+}
+
+TEST_F(OwnedRegion, freed_blocks_are_reused) {
+    auto region = owned_region::create_file(path.c_str(), 1 << 16);
+    {
+        auto node = region.make_owned<Node>(1);
+    }
+    const auto used = region.used();
+    auto node = region.make_owned<Node>(2);
+    ASSERT_EQ(region.used(), used);
+}
+
+TEST_F(OwnedRegion, zombie_block_is_kept_until_last_dep) {
+    auto region = owned_region::create_file(path.c_str(), 1 << 16);
+    auto node = region.make_owned<Node>(1);
+    auto dep = node.make_dep();
+    node = region_owned_ptr<Node>{};
+    const auto used = region.used();
+    auto other = region.make_owned<Node>(2);
+    ASSERT_GT(region.used(), used);
+}
+
+TEST_F(OwnedRegion, full_region_returns_empty_handle) {
+    auto region = owned_region::create_file(path.c_str(), 1024);
+    vector<region_owned_ptr<Graph>> graphs;
+    for (;;) {
+        auto graph = region.make_owned<Graph>();
+        if (graph == nullptr) {
+            break;
+        }
+        graphs.push_back(std::move(graph));
+    }
+    ASSERT_FALSE(graphs.empty());
+    ASSERT_LE(region.used(), region.size());
+    graphs.pop_back();
+    ASSERT_NE(region.make_owned<Graph>(), nullptr);
+}
+
+TEST_F(OwnedRegion, opening_missing_or_foreign_file_fails) {
+    ASSERT_FALSE(owned_region::open_file(path.c_str()).is_open());
+    FILE *file = fopen(path.c_str(), "w");
+    fputs("not a region, but long enough to have a header", file);
+    fclose(file);
+    ASSERT_FALSE(owned_region::open_file(path.c_str()).is_open());
+}
+
+TEST_F(OwnedRegion, block_is_returned_when_constructor_throws) {
+    auto region = owned_region::create_file(path.c_str(), 1 << 16);
+    ASSERT_THROW(region.make_owned<Throwing>(true), runtime_error);
+    const auto used = region.used();
+    auto object = region.make_owned<Throwing>(false);
+    ASSERT_NE(object, nullptr);
+    ASSERT_EQ(region.used(), used);
+}
+
+TEST_F(OwnedRegion, opening_truncated_or_corrupt_file_fails) {
+    {
+        auto region = owned_region::create_file(path.c_str(), 1 << 16);
+        build(region);
+    }
+    ASSERT_EQ(truncate(path.c_str(), 4096), 0);
+    ASSERT_FALSE(owned_region::open_file(path.c_str()).is_open());
+
+    {
+        auto region = owned_region::create_file(path.c_str(), 1 << 16);
+        build(region);
+    }
+    // Overwrites the used field of the header with more than the size
+    const std::uint64_t used = 1 << 20;
+    const int fd = open(path.c_str(), O_RDWR);
+    ASSERT_EQ(pwrite(fd, &used, sizeof(used), 2 * sizeof(std::uint64_t)), static_cast<ssize_t>(sizeof(used)));
+    close(fd);
+    ASSERT_FALSE(owned_region::open_file(path.c_str()).is_open());
+}
+
+TEST(OwnedRegionSharedMemory, graph_is_visible_in_another_process) {
+    const auto name = "/owned_region_test_" + to_string(getpid());
+    auto region = owned_region::create_shared_memory(name.c_str(), 1 << 16);
+    ASSERT_TRUE(region.is_open());
+    build(region);
+    const auto child = fork();
+    if (child == 0) {
+        auto other = owned_region::open_shared_memory(name.c_str());
+        _exit(other.is_open() && other.root<Node>()->child->value == 2 ? 0 : 1);
+    }
+    int status{};
+    waitpid(child, &status, 0);
+    shm_unlink(name.c_str());
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+}
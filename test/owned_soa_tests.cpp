@@ -0,0 +1,205 @@
+#include "owned_soa.h"
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+namespace {
+    size_t failing_realloc_size{0};
+}
+
+// Lets the tests make the next reallocation to a given size fail
+extern "C" void *realloc(void *pointer, size_t size) noexcept {
+    if (failing_realloc_size != 0 && size == failing_realloc_size) {
+        failing_realloc_size = 0;
+        return nullptr;
+    }
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+namespace {
+    struct recording_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static int failures;
+    };
+
+    int recording_error_handler::failures{0};
+
+    using particles = basic_owned_soa<recording_error_handler, float, float, int>;
+
+    struct OwnedSoa : public testing::Test {
+        OwnedSoa() {
+            recording_error_handler::failures = 0;
+        }
+    };
+}
+
+TEST_F(OwnedSoa, rows_are_stored_in_columns) {
+    particles soa;
+    auto a = soa.add(1.0f, 2.0f, 3);
+    auto b = soa.add(4.0f, 5.0f, 6);
+    ASSERT_EQ(soa.size(), 2u);
+    ASSERT_EQ(soa.column<0>()[1], 4.0f);
+    ASSERT_EQ(soa.column<2>()[0], 3);
+    ASSERT_EQ(b.get<1>(), 5.0f);
+    a.get<2>() = 7;
+    ASSERT_EQ(soa.column<2>()[0], 7);
+}
+
+TEST_F(OwnedSoa, columns_are_aligned) {
+    particles soa;
+    auto a = soa.add(1.0f, 2.0f, 3);
+    for (const void *column: {static_cast<const void *>(soa.column<0>()), static_cast<const void *>(soa.column<1>()),
+                              static_cast<const void *>(soa.column<2>())}) {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(column) % particles::column_alignment, 0u);
+    }
+}
+
+TEST_F(OwnedSoa, destroying_row_owner_keeps_columns_dense) {
+    particles soa;
+    auto a = make_unique<particles::row>(soa.add(1.0f, 0.0f, 1));
+    auto b = soa.add(2.0f, 0.0f, 2);
+    auto c = soa.add(3.0f, 0.0f, 3);
+    a = nullptr;
+    ASSERT_EQ(soa.size(), 2u);
+    ASSERT_EQ(soa.column<2>()[0], 3);
+    ASSERT_EQ(c.index(), 0u);
+    ASSERT_EQ(c.get<2>(), 3);
+    ASSERT_EQ(b.get<2>(), 2);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(OwnedSoa, row_dep_follows_moved_row) {
+    particles soa;
+    auto a = make_unique<particles::row>(soa.add(1.0f, 0.0f, 1));
+    auto b = soa.add(2.0f, 0.0f, 2);
+    auto dep = b.make_dep();
+    ASSERT_EQ(b.num_deps(), 1u);
+    a = nullptr;
+    ASSERT_TRUE(dep.has_owner());
+    ASSERT_EQ(dep.get<2>(), 2);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(OwnedSoa, row_dep_reports_deleted_row) {
+    particles soa;
+    auto a = make_unique<particles::row>(soa.add(1.0f, 0.0f, 1));
+    auto dep = a->make_dep();
+    a = nullptr;
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_EQ(recording_error_handler::failures, 0);
+    (void) dep.get<2>();
+    ASSERT_EQ(recording_error_handler::failures, 1);
+}
+
+TEST_F(OwnedSoa, slot_of_deleted_row_is_not_reused_while_deps_exist) {
+    particles soa;
+    auto a = make_unique<particles::row>(soa.add(1.0f, 0.0f, 1));
+    auto dep = a->make_dep();
+    a = nullptr;
+    auto b = soa.add(2.0f, 0.0f, 2);
+    ASSERT_FALSE(dep.has_owner());
+}
+
+TEST_F(OwnedSoa, handles_outlive_container) {
+    auto soa = make_unique<particles>();
+    auto row = soa->add(1.0f, 2.0f, 3);
+    auto row_dep = row.make_dep();
+    auto column_dep = soa->make_column_dep<0>();
+    soa = nullptr;
+    ASSERT_FALSE(row_dep.has_owner());
+    ASSERT_FALSE(column_dep.has_owner());
+    ASSERT_EQ(row.num_deps(), 0u);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+    (void) column_dep.data();
+    ASSERT_EQ(recording_error_handler::failures, 1);
+}
+
+TEST_F(OwnedSoa, column_dep_spans_rows) {
+    particles soa;
+    vector<particles::row> rows;
+    for (int i = 0; i < 5; ++i) {
+        rows.push_back(soa.add(static_cast<float>(i), 0.0f, i));
+    }
+    auto ids = soa.make_column_dep<2>();
+    ASSERT_EQ(ids.size(), 5u);
+    int sum = 0;
+    for (auto id: ids) {
+        sum += id;
+    }
+    ASSERT_EQ(sum, 10);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(OwnedSoa, column_dep_reports_changed_columns) {
+    particles soa;
+    auto a = make_unique<particles::row>(soa.add(1.0f, 0.0f, 1));
+    auto b = soa.add(2.0f, 0.0f, 2);
+    auto column = soa.make_column_dep<0>();
+    auto c = soa.add(3.0f, 0.0f, 3);
+    ASSERT_TRUE(column.has_owner());
+    a = nullptr;
+    ASSERT_FALSE(column.has_owner());
+    (void) column.data();
+    ASSERT_EQ(recording_error_handler::failures, 1);
+}
+
+TEST_F(OwnedSoa, growing_keeps_rows) {
+    particles soa{2};
+    vector<particles::row> rows;
+    for (int i = 0; i < 100; ++i) {
+        rows.push_back(soa.add(static_cast<float>(i), 0.0f, i));
+    }
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(rows[static_cast<size_t>(i)].get<2>(), i);
+    }
+}
+
+TEST_F(OwnedSoa, failed_allocation_throws_bad_alloc) {
+    ASSERT_THROW(particles{size_t{1} << 58u}, bad_alloc);
+    particles soa{};
+    auto row = soa.add(1.0f, 2.0f, 3);
+    ASSERT_EQ(soa.size(), 1u);
+    ASSERT_EQ(row.get<2>(), 3);
+}
+
+#ifdef __GLIBC__
+TEST_F(OwnedSoa, failed_slot_allocation_leaves_container_unchanged) {
+    particles soa{};
+    vector<particles::row> rows;
+    for (int i = 0; i < 16; ++i) {
+        rows.push_back(soa.add(static_cast<float>(i), 0.0f, i));
+    }
+    auto column = soa.make_column_dep<2>();
+    // The columns and the slots both grow from 16 to 32 entries, and a slot is two words
+    failing_realloc_size = 32 * 2 * sizeof(size_t);
+    ASSERT_THROW((void) soa.add(16.0f, 0.0f, 16), bad_alloc);
+    ASSERT_EQ(failing_realloc_size, 0u);
+    ASSERT_EQ(soa.size(), 16u);
+    ASSERT_TRUE(column.has_owner());
+    ASSERT_EQ(column.size(), 16u);
+    for (int i = 0; i < 16; ++i) {
+        ASSERT_EQ(rows[static_cast<size_t>(i)].get<2>(), i);
+    }
+    auto row = soa.add(16.0f, 0.0f, 16);
+    ASSERT_EQ(row.get<2>(), 16);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+#endif
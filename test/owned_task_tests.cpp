@@ -0,0 +1,143 @@
+#include "owned_task.h"
+
+#include <coroutine>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    /// An awaitable that is completed manually by the test
+    struct event {
+        std::coroutine_handle<> waiter{};
+        int value{};
+
+        bool await_ready() noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept { waiter = handle; }
+
+        int await_resume() noexcept { return value; }
+
+        void complete(int v) {
+            value = v;
+            std::exchange(waiter, nullptr).resume();
+        }
+    };
+
+    struct Session {
+        lifetime_signal closed;
+        vector<int> received;
+    };
+
+    /// Counts destructions, to check that locals of a cancelled task are destroyed
+    struct Guard {
+        explicit Guard(int &count) : count{count} {}
+
+        ~Guard() { count++; }
+
+        int &count;
+    };
+
+    owned_task<Session> receive(dep_ptr<Session> session, event &input, int &steps, int &guards) {
+        Guard guard{guards};
+        for (;;) {
+            const auto value = co_await input;
+            steps++;
+            session->received.push_back(value);
+        }
+    }
+
+    owned_task<Session> wait_for_close(dep_ptr<Session> watcher, dep_ptr<Session> session, string &log) {
+        co_await session->closed.destroyed();
+        log += session.has_owner() ? "alive" : "closed";
+        log += watcher->received.empty() ? "" : "!";
+    }
+}
+
+TEST(OwnedTask, runs_while_owner_exists) {
+    auto session = make_owned<Session>();
+    event input;
+    int steps{};
+    int guards{};
+    receive(session.make_dep(), input, steps, guards);
+    input.complete(1);
+    input.complete(2);
+    ASSERT_EQ(steps, 2);
+    ASSERT_EQ(session->received, (vector<int>{1, 2}));
+    ASSERT_EQ(guards, 0);
+    session = make_owned<Session>();
+    input.complete(3);
+    ASSERT_EQ(guards, 1);
+}
+
+TEST(OwnedTask, stops_when_resumed_after_owner_is_destroyed) {
+    auto session = make_owned<Session>();
+    auto dep = session.make_dep();
+    event input;
+    int steps{};
+    int guards{};
+    receive(dep, input, steps, guards);
+    input.complete(1);
+    ASSERT_EQ(session.num_deps(), 3u);
+    session = make_owned<Session>();
+    ASSERT_EQ(guards, 0);
+    input.complete(2);
+    ASSERT_EQ(steps, 1);
+    ASSERT_EQ(guards, 1);
+    ASSERT_EQ(input.waiter, nullptr);
+}
+
+TEST(OwnedTask, does_not_start_without_owner) {
+    auto session = make_owned<Session>();
+    auto dep = session.make_dep();
+    session = make_owned<Session>();
+    event input;
+    int steps{};
+    int guards{};
+    receive(dep, input, steps, guards);
+    ASSERT_EQ(input.waiter, nullptr);
+    ASSERT_EQ(guards, 0);
+}
+
+TEST(OwnedTask, lifetime_signal_completes_when_owner_is_destroyed) {
+    auto watcher = make_owned<Session>();
+    auto session = make_owned<Session>();
+    string log;
+    wait_for_close(watcher.make_dep(), session.make_dep(), log);
+    ASSERT_EQ(log, "");
+    session = make_owned<Session>();
+    ASSERT_EQ(log, "closed");
+}
+
+TEST(OwnedTask, task_waiting_for_its_own_owner_is_destroyed) {
+    auto session = make_owned<Session>();
+    auto dep = session.make_dep();
+    string log;
+    wait_for_close(dep, dep, log);
+    ASSERT_EQ(session.num_deps(), 4u);
+    session = make_owned<Session>();
+    ASSERT_EQ(log, "");
+    ASSERT_FALSE(dep.has_owner());
+}
+
+TEST(OwnedTask, lifetime_signal_resumes_all_waiters) {
+    auto watcher = make_owned<Session>();
+    auto session = make_owned<Session>();
+    string log;
+    wait_for_close(watcher.make_dep(), session.make_dep(), log);
+    wait_for_close(watcher.make_dep(), session.make_dep(), log);
+    session = make_owned<Session>();
+    ASSERT_EQ(log, "closedclosed");
+}
+
+TEST(OwnedTask, waiter_without_owner_is_not_resumed) {
+    auto watcher = make_owned<Session>();
+    auto session = make_owned<Session>();
+    string log;
+    wait_for_close(watcher.make_dep(), session.make_dep(), log);
+    watcher = make_owned<Session>();
+    session = make_owned<Session>();
+    ASSERT_EQ(log, "");
+}
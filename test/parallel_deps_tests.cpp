@@ -0,0 +1,140 @@
+#include "parallel_deps.h"
+
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#ifdef __GLIBC__
+#include <cerrno>
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+#ifdef __GLIBC__
+namespace {
+    int threads_until_failure{-1};
+}
+
+// Lets the tests make thread creation fail after a number of threads
+extern "C" int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *), void *arg) {
+    if (threads_until_failure == 0) {
+        return EAGAIN;
+    }
+    if (threads_until_failure > 0) {
+        --threads_until_failure;
+    }
+    using create_function = int (*)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+    static const auto next = reinterpret_cast<create_function>(dlsym(RTLD_NEXT, "pthread_create"));
+    return next(thread, attr, start, arg);
+}
+#endif
+
+namespace {
+    struct recording_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static int failures;
+    };
+
+    int recording_error_handler::failures{0};
+
+    struct Cell {
+        explicit Cell(long value) : value{value} {}
+
+        long value;
+    };
+
+    using Owner = owned_ptr<Cell, recording_error_handler>;
+    using Dep = dep_ptr<Cell, recording_error_handler>;
+
+    struct ParallelDeps : public testing::Test {
+        ParallelDeps() {
+            recording_error_handler::failures = 0;
+            for (long i = 0; i < 1000; ++i) {
+                owners.emplace_back(i);
+                deps.push_back(owners.back().make_dep());
+            }
+        }
+
+        vector<Owner> owners;
+        vector<Dep> deps;
+    };
+}
+
+TEST_F(ParallelDeps, for_each_visits_every_target_without_counting) {
+    parallel_for_each_dep(deps.begin(), deps.end(), [](Cell &cell) { cell.value *= 2; }, 4);
+    for (long i = 0; i < 1000; ++i) {
+        ASSERT_EQ(owners[static_cast<size_t>(i)]->value, 2 * i);
+        ASSERT_EQ(owners[static_cast<size_t>(i)].num_deps(), 1u);
+    }
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+
+TEST_F(ParallelDeps, transform_writes_results_in_range_order) {
+    vector<long> squares(deps.size());
+    auto end = parallel_transform_dep(deps.begin(), deps.end(), squares.begin(),
+                                      [](const Cell &cell) { return cell.value * cell.value; }, 3);
+    ASSERT_EQ(end, squares.end());
+    for (long i = 0; i < 1000; ++i) {
+        ASSERT_EQ(squares[static_cast<size_t>(i)], i * i);
+    }
+}
+
+TEST_F(ParallelDeps, transform_reduce_matches_serial_result) {
+    const auto sum = parallel_transform_reduce_dep(deps.begin(), deps.end(), 10L, plus<>{},
+                                                   [](const Cell &cell) { return cell.value; });
+    ASSERT_EQ(sum, 10L + 999L * 1000 / 2);
+    vector<dep_ptr_const<Cell, recording_error_handler>> const_deps;
+    for (auto &owner: owners) {
+        const_deps.emplace_back(owner);
+    }
+    const auto count = parallel_transform_reduce_dep(const_deps.begin(), const_deps.end(), size_t{0}, plus<>{},
+                                                     [](const Cell &) { return size_t{1}; }, 7);
+    ASSERT_EQ(count, 1000u);
+}
+
+TEST_F(ParallelDeps, dependencies_without_owner_are_reported_and_skipped) {
+    owners[3] = Owner{-1};
+    owners[500] = Owner{-1};
+    long visited = 0;
+    parallel_for_each_dep(deps.begin(), deps.end(), [&](Cell &) { ++visited; }, 1);
+    ASSERT_EQ(visited, 998);
+    ASSERT_EQ(recording_error_handler::failures, 2);
+}
+
+TEST_F(ParallelDeps, owner_destroyed_during_the_parallel_part_is_reported) {
+    parallel_for_each_dep(deps.begin(), deps.end(), [&](Cell &cell) {
+        if (cell.value == 10) {
+            owners[20] = Owner{-1};
+        }
+    }, 1);
+    ASSERT_EQ(recording_error_handler::failures, 1);
+}
+
+TEST_F(ParallelDeps, empty_range) {
+    deps.clear();
+    parallel_for_each_dep(deps.begin(), deps.end(), [](Cell &) {});
+    ASSERT_EQ(parallel_transform_reduce_dep(deps.begin(), deps.end(), 5, plus<>{},
+                                            [](const Cell &) { return 1; }), 5);
+}
+
+#ifdef __GLIBC__
+TEST_F(ParallelDeps, chunks_of_threads_that_cannot_be_started_run_on_the_calling_thread) {
+    threads_until_failure = 1;
+    const auto sum = parallel_transform_reduce_dep(deps.begin(), deps.end(), 0L, plus<>{},
+                                                   [](const Cell &cell) { return cell.value; }, 4);
+    threads_until_failure = -1;
+    ASSERT_EQ(sum, 999L * 1000L / 2);
+    ASSERT_EQ(recording_error_handler::failures, 0);
+}
+#endif
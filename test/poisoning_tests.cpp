@@ -0,0 +1,51 @@
+#include "owned_ptr.h"
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+#ifdef OWNED_PTR_HAS_ASAN
+
+namespace {
+    struct Payload {
+        long values[4]{1, 2, 3, 4};
+    };
+
+    long read(const volatile long *value) {
+        return *value;
+    }
+}
+
+TEST(Poisoning, zombie_storage_is_poisoned_until_block_is_freed) {
+    auto owner = make_unique<owned_ptr<Payload>>();
+    auto dep = owner->make_dep();
+    const Payload *raw = *owner;
+    ASSERT_FALSE(__asan_address_is_poisoned(raw));
+    owner = nullptr;
+    ASSERT_TRUE(__asan_address_is_poisoned(raw));
+    ASSERT_TRUE(__asan_address_is_poisoned(&raw->values[3]));
+}
+
+TEST(Poisoning, storage_is_not_poisoned_while_owner_exists) {
+    auto owner = owned_ptr<Payload>{};
+    auto dep = owner.make_dep();
+    ASSERT_FALSE(__asan_address_is_poisoned(static_cast<const Payload *>(owner)));
+}
+
+TEST(PoisoningDeathTest, raw_pointer_escape_is_caught) {
+    auto owner = make_unique<owned_ptr<Payload>>();
+    auto dep = owner->make_dep();
+    const Payload *raw = *owner;
+    owner = nullptr;
+    EXPECT_DEATH(read(&raw->values[0]), "use-after-poison");
+}
+
+#else
+
+TEST(Poisoning, requires_address_sanitizer) {
+    GTEST_SKIP() << "Build with -fsanitize=address to test poisoning of zombie blocks";
+}
+
+#endif
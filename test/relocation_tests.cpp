@@ -0,0 +1,106 @@
+#include "owned_relocation.h"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Item {
+        explicit Item(int id) : id{id}, name{"item " + to_string(id)} {
+            alive++;
+        }
+
+        Item(Item &&other) noexcept: id{other.id}, name{std::move(other.name)} {
+            alive++;
+        }
+
+        ~Item() {
+            alive--;
+        }
+
+        int id;
+        string name;
+
+        static int alive;
+    };
+
+    int Item::alive{0};
+
+    /// Owners of ids 0..count-1, with the blocks interleaved with other allocations
+    vector<owned_ptr<Item>> scattered(int count) {
+        vector<owned_ptr<Item>> items;
+        vector<owned_ptr<Item>> garbage;
+        for (int i = 0; i < count; ++i) {
+            garbage.push_back(make_owned<Item>(-1));
+            items.push_back(make_owned<Item>(i));
+        }
+        return items;
+    }
+
+    struct Relocation : public testing::Test {
+        ~Relocation() override {
+            release_unused_locality_slabs();
+            EXPECT_EQ(owned_ptr_detail::locality_slabs, nullptr);
+            EXPECT_EQ(Item::alive, 0);
+        }
+    };
+}
+
+TEST_F(Relocation, unshared_objects_are_moved_into_contiguous_blocks) {
+    auto items = scattered(16);
+    ASSERT_EQ(relocate_for_locality(items.begin(), items.end()), 16u);
+    ASSERT_EQ(Item::alive, 16);
+    const auto stride = reinterpret_cast<char *>(static_cast<Item *>(items[1])) -
+                        reinterpret_cast<char *>(static_cast<Item *>(items[0]));
+    for (int i = 0; i < 16; ++i) {
+        ASSERT_EQ(items[i]->id, i);
+        ASSERT_EQ(items[i]->name, "item " + to_string(i));
+        ASSERT_EQ(reinterpret_cast<char *>(static_cast<Item *>(items[i])) -
+                  reinterpret_cast<char *>(static_cast<Item *>(items[0])), stride * i);
+    }
+}
+
+TEST_F(Relocation, objects_with_dependencies_stay) {
+    auto items = scattered(4);
+    auto dep = items[2].make_dep();
+    auto *before = static_cast<Item *>(items[2]);
+    ASSERT_EQ(relocate_for_locality(items.begin(), items.end()), 3u);
+    ASSERT_EQ(static_cast<Item *>(items[2]), before);
+    ASSERT_EQ(dep->id, 2);
+}
+
+TEST_F(Relocation, relocated_owners_keep_their_semantics) {
+    auto items = scattered(3);
+    relocate_for_locality(items.begin(), items.end());
+    auto dep = items[1].make_dep();
+    ASSERT_EQ(items[1].num_deps(), 1u);
+    ASSERT_EQ(dep->name, "item 1");
+    items[1] = make_owned<Item>(7);
+    ASSERT_FALSE(dep.has_owner());
+    ASSERT_EQ(Item::alive, 3);
+}
+
+TEST_F(Relocation, slab_is_freed_when_all_blocks_are_unused) {
+    auto items = scattered(3);
+    relocate_for_locality(items.begin(), items.end());
+    {
+        auto dep = items[0].make_dep();
+        items.clear();
+        ASSERT_EQ(release_unused_locality_slabs(), 0u);
+    }
+    ASSERT_EQ(release_unused_locality_slabs(), 1u);
+}
+
+TEST_F(Relocation, relocating_again_moves_out_of_the_old_slab) {
+    auto items = scattered(3);
+    relocate_for_locality(items.begin(), items.end());
+    items.push_back(make_owned<Item>(3));
+    ASSERT_EQ(relocate_for_locality(items.begin(), items.end()), 4u);
+    ASSERT_EQ(items[3]->id, 3);
+    // The first slab is only freed by the next call, or here
+    ASSERT_EQ(release_unused_locality_slabs(), 1u);
+    ASSERT_NE(owned_ptr_detail::locality_slabs, nullptr);
+}
@@ -0,0 +1,83 @@
+#include "owned_ptr.h"
+
+#include <exception>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    class FailureDetected : public runtime_error {
+    public:
+        explicit FailureDetected(const string& message) : runtime_error(message) {}
+    };
+
+    struct throwing_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            if (!condition) {
+                throw FailureDetected(reason);
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+    };
+
+    template<typename T>
+    void use(T&& t) {
+        (void)t;
+    }
+
+    using handler = sampling_error_handler<4, throwing_error_handler>;
+    using ptr = owned_ptr<string, handler>;
+
+    struct Sampling : public testing::Test {
+        Sampling() {
+            handler::force_check();
+            handler::reset_stats();
+        }
+    };
+}
+
+TEST_F(Sampling, one_in_period_dereferences_is_checked) {
+    auto foo = ptr("foo");
+    auto dep = foo.make_dep();
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_EQ(*dep, "foo");
+    }
+    ASSERT_EQ(2u, handler::stats().checked);
+    ASSERT_EQ(6u, handler::stats().skipped);
+}
+
+TEST_F(Sampling, owner_deleted_then_sampled_dereference_detects_error) {
+    auto foo = make_unique<ptr>("foo");
+    auto dep = foo->make_dep();
+    foo = nullptr;
+    ASSERT_THROW(use(dep->length()), FailureDetected);
+    for (int i = 0; i < 3; ++i) {
+        use(static_cast<string *>(dep));
+    }
+    ASSERT_THROW(use(dep->length()), FailureDetected);
+}
+
+TEST_F(Sampling, dereference_after_move_is_checked) {
+    auto foo = make_unique<ptr>("foo");
+    auto dep = foo->make_dep();
+    ASSERT_EQ(*dep, "foo");
+    auto dep2{std::move(dep)};
+    foo = nullptr;
+    ASSERT_THROW(use(dep2->length()), FailureDetected);
+    ASSERT_EQ(2u, handler::stats().checked);
+    ASSERT_EQ(0u, handler::stats().skipped);
+}
+
+TEST_F(Sampling, const_dep_is_sampled) {
+    const auto foo = ptr("foo");
+    auto dep = foo.make_dep();
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_EQ(dep->length(), 3u);
+    }
+    ASSERT_EQ(1u, handler::stats().checked);
+    ASSERT_EQ(3u, handler::stats().skipped);
+}
@@ -0,0 +1,86 @@
+#include "owned_ptr.h"
+
+#include <gtest/gtest.h>
+
+#ifdef OWNED_PTR_HAS_ASAN
+#include <sanitizer/lsan_interface.h>
+#endif
+
+namespace {
+    struct strict_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+
+        static constexpr bool forbid_zombies{true};
+
+        static int failures;
+    };
+
+    int strict_error_handler::failures{0};
+
+    struct Counted {
+        Counted() { alive++; }
+
+        ~Counted() { alive--; }
+
+        int value{5};
+
+        static int alive;
+    };
+
+    int Counted::alive{0};
+
+    struct StrictLifetime : public testing::Test {
+        StrictLifetime() {
+            strict_error_handler::failures = 0;
+            Counted::alive = 0;
+        }
+    };
+}
+
+TEST_F(StrictLifetime, dependencies_released_before_owner_are_fine) {
+    {
+        owned_ptr<Counted, strict_error_handler> owner{};
+        auto dep = owner.make_dep();
+        auto copy = dep;
+        ASSERT_EQ(owner.num_deps(), 2u);
+        ASSERT_EQ(copy->value, 5);
+    }
+    ASSERT_EQ(strict_error_handler::failures, 0);
+    ASSERT_EQ(Counted::alive, 0);
+}
+
+TEST_F(StrictLifetime, dependency_destruction_only_decrements) {
+    owned_ptr<Counted, strict_error_handler> owner{};
+    {
+        auto dep = owner.make_dep();
+        dep_ptr_const<Counted, strict_error_handler> const_dep{owner};
+        ASSERT_EQ(owner.num_deps(), 2u);
+    }
+    ASSERT_EQ(owner.num_deps(), 0u);
+    ASSERT_EQ(owner->value, 5);
+}
+
+TEST_F(StrictLifetime, owner_destroyed_with_dependencies_is_reported) {
+#ifdef OWNED_PTR_HAS_ASAN
+    __lsan::ScopedDisabler leaked_on_purpose;
+#endif
+    auto *owner = new owned_ptr<Counted, strict_error_handler>{};
+    auto dep = owner->make_dep();
+    delete owner;
+    ASSERT_EQ(strict_error_handler::failures, 1);
+    ASSERT_EQ(Counted::alive, 0);
+    // The block is leaked instead of freed, so the dependency is still safe to use
+    ASSERT_FALSE(dep.has_owner());
+}
+
+TEST(StrictLifetimeLayout, default_handler_allows_zombies) {
+    static_assert(!owned_ptr_detail::forbids_zombies<owned_ptr_error_handler>::value, "");
+    static_assert(owned_ptr_detail::forbids_zombies<strict_error_handler>::value, "");
+}
@@ -0,0 +1,112 @@
+#include "owned_ptr.h"
+
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct recording_error_handler {
+        static void check_condition(bool condition, const char *reason) {
+            (void) reason;
+            if (!condition) {
+                failures++;
+            }
+        }
+
+        static constexpr bool reset_when_moved_from{true};
+        static constexpr bool check_thread_affinity{true};
+
+        static int failures;
+    };
+
+    int recording_error_handler::failures{0};
+
+    using ptr = owned_ptr<string, recording_error_handler>;
+
+    template<class F>
+    void on_other_thread(F f) {
+        std::thread{f}.join();
+    }
+
+    struct ThreadAffinity : public testing::Test {
+        ThreadAffinity() {
+            recording_error_handler::failures = 0;
+        }
+    };
+}
+
+TEST_F(ThreadAffinity, same_thread_is_accepted) {
+    auto foo = ptr("foo");
+    auto dep = foo.make_dep();
+    auto dep2{dep};
+    const auto &const_foo = foo;
+    auto dep3 = const_foo.make_dep();
+    ASSERT_EQ(*dep2, "foo");
+    ASSERT_EQ(*dep3, "foo");
+    ASSERT_EQ(0, recording_error_handler::failures);
+}
+
+TEST_F(ThreadAffinity, dep_created_on_other_thread_is_detected) {
+    auto foo = ptr("foo");
+    on_other_thread([&] {
+        auto dep = foo.make_dep();
+    });
+    ASSERT_EQ(2, recording_error_handler::failures); // Creation and destruction
+}
+
+TEST_F(ThreadAffinity, dep_copied_on_other_thread_is_detected) {
+    auto foo = ptr("foo");
+    const auto &const_foo = foo;
+    auto dep = foo.make_dep();
+    auto dep_const = const_foo.make_dep();
+    on_other_thread([&] {
+        auto copy = dep;
+        auto copy_const = dep_const;
+    });
+    ASSERT_EQ(4, recording_error_handler::failures); // Copies and destructions
+}
+
+TEST_F(ThreadAffinity, dep_destroyed_on_other_thread_is_detected) {
+    auto foo = ptr("foo");
+    auto dep = make_unique<dep_ptr<string, recording_error_handler>>(foo.make_dep());
+    on_other_thread([&] {
+        dep = nullptr;
+    });
+    ASSERT_EQ(1, recording_error_handler::failures);
+}
+
+TEST_F(ThreadAffinity, owner_with_deps_destroyed_on_other_thread_is_detected) {
+    auto foo = make_unique<ptr>("foo");
+    auto dep = foo->make_dep();
+    on_other_thread([&] {
+        foo = nullptr;
+    });
+    ASSERT_EQ(1, recording_error_handler::failures);
+}
+
+TEST_F(ThreadAffinity, owner_without_deps_can_be_destroyed_on_other_thread) {
+    auto foo = make_unique<ptr>("foo");
+    on_other_thread([&] {
+        foo = nullptr;
+    });
+    ASSERT_EQ(0, recording_error_handler::failures);
+}
+
+TEST_F(ThreadAffinity, transfer_to_current_thread_allows_handoff) {
+    auto foo = ptr("foo");
+    auto dep = make_unique<dep_ptr<string, recording_error_handler>>(foo.make_dep());
+    on_other_thread([&] {
+        foo.transfer_to_current_thread();
+        auto dep2 = foo.make_dep();
+        dep = nullptr;
+    });
+    ASSERT_EQ(0, recording_error_handler::failures);
+    dep = make_unique<dep_ptr<string, recording_error_handler>>(foo.make_dep());
+    ASSERT_EQ(1, recording_error_handler::failures);
+    dep->transfer_to_current_thread();
+    dep = nullptr;
+    ASSERT_EQ(1, recording_error_handler::failures);
+}
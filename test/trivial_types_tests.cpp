@@ -0,0 +1,101 @@
+#include "owned_ptr.h"
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+    struct Point {
+        double x;
+        double y;
+        double z;
+    };
+
+    struct Counted {
+        explicit Counted(int value) : value{value} {
+            constructed++;
+        }
+
+        Counted(const Counted &other) : value{other.value} {
+            constructed++;
+        }
+
+        ~Counted() {
+            destroyed++;
+        }
+
+        int value;
+        static int constructed;
+        static int destroyed;
+    };
+
+    int Counted::constructed{0};
+    int Counted::destroyed{0};
+
+    struct TrivialTypes : public testing::Test {
+        TrivialTypes() {
+            Counted::constructed = 0;
+            Counted::destroyed = 0;
+        }
+    };
+}
+
+TEST_F(TrivialTypes, trivially_destructible_owner_deleted_first) {
+    auto foo = make_unique<owned_ptr<Point>>(Point{1, 2, 3});
+    auto dep = foo->make_dep();
+    ASSERT_EQ(2, dep->y);
+    ASSERT_TRUE(dep.has_owner());
+    foo = nullptr;
+    ASSERT_FALSE(dep.has_owner());
+}
+
+TEST_F(TrivialTypes, clone_trivially_copyable) {
+    auto foo = make_owned<Point>(Point{1, 2, 3});
+    auto copy = foo.clone();
+    ASSERT_NE(foo, copy);
+    ASSERT_EQ(1, copy->x);
+    ASSERT_EQ(3, copy->z);
+    copy->x = 4;
+    ASSERT_EQ(1, foo->x);
+    ASSERT_EQ(0u, copy.num_deps());
+}
+
+TEST_F(TrivialTypes, clone_non_trivial) {
+    auto foo = make_owned<string>("foo");
+    auto copy = foo.clone();
+    ASSERT_EQ("foo", *copy);
+    copy->append("bar");
+    ASSERT_EQ("foo", *foo);
+}
+
+TEST_F(TrivialTypes, make_owned_n_trivially_copyable) {
+    vector<owned_ptr<Point>> points;
+    make_owned_n<Point>(back_inserter(points), 4, Point{1, 2, 3});
+    ASSERT_EQ(4u, points.size());
+    for (auto &point: points) {
+        ASSERT_EQ(2, point->y);
+    }
+    ASSERT_NE(points[0], points[1]);
+}
+
+TEST_F(TrivialTypes, make_owned_n_non_trivial) {
+    {
+        vector<owned_ptr<Counted>> objects;
+        make_owned_n<Counted>(back_inserter(objects), 3, 42);
+        ASSERT_EQ(3u, objects.size());
+        ASSERT_EQ(42, objects[2]->value);
+        ASSERT_EQ(3, Counted::constructed);
+    }
+    ASSERT_EQ(3, Counted::destroyed);
+}
+
+TEST_F(TrivialTypes, make_owned_n_zero) {
+    vector<owned_ptr<Point>> points;
+    make_owned_n<Point>(back_inserter(points), 0, Point{});
+    ASSERT_TRUE(points.empty());
+}